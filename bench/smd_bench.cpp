@@ -0,0 +1,200 @@
+#include "disassembler.hpp"
+#include "smd.hpp"
+#include "smd_generator.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+/*
+ *=======================*
+ * ALLOCATION ACCOUNTING *
+ *=======================*
+ */
+namespace
+{
+    std::atomic<std::size_t> allocations = 0;
+}
+
+void *operator new( std::size_t size )
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    if ( void *p = std::malloc( size == 0 ? 1 : size ) )
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[]( std::size_t size )
+{
+    return ::operator new( size );
+}
+
+void operator delete( void *p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void *p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete[]( void *p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+
+namespace
+{
+    struct Stage
+    {
+        const char *name;
+        double      seconds     = 0;
+        std::size_t bytes       = 0;
+        std::size_t opcodes     = 0;
+        std::size_t allocations = 0;
+    };
+
+    template <typename Body> void Measure( Stage &stage, unsigned int iterations, std::size_t bytes, Body body )
+    {
+        std::size_t before = allocations.load();
+        auto        start  = std::chrono::steady_clock::now();
+
+        for ( unsigned int i = 0; i < iterations; i++ )
+            stage.opcodes += body();
+
+        stage.seconds     = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        stage.bytes       = bytes * iterations;
+        stage.allocations = allocations.load() - before;
+    }
+
+    void Report( const Stage &stage, unsigned int iterations )
+    {
+        std::printf( "%-12s %10.2f MB/s", stage.name, stage.bytes / stage.seconds / 1e6 );
+
+        if ( stage.opcodes > 0 )
+            std::printf( " %14.0f opcodes/s", stage.opcodes / stage.seconds );
+        else
+            std::printf( " %24s", "" );
+
+        std::printf( " %8.2f allocations/file\n", (double)stage.allocations / iterations );
+    }
+
+    void Usage( const char *program )
+    {
+        std::fprintf( stderr, "Usage: %s [--seed N] [--channels N] [--size BYTES_PER_CHANNEL] [--iterations N]\n",
+                      program );
+    }
+} // namespace
+
+int main( int argc, char **argv )
+{
+    GeneratorOptions options;
+    unsigned int     iterations = 2000;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( i + 1 >= argc )
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+
+        if ( std::strcmp( argv[i], "--seed" ) == 0 )
+            options.seed = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--channels" ) == 0 )
+            options.channels = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--size" ) == 0 )
+            options.bytes_per_channel = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--iterations" ) == 0 )
+            iterations = std::max( 1ul, std::strtoul( argv[++i], nullptr, 10 ) );
+        else
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* The parse stage goes through the file system like a real conversion does */
+    std::vector<unsigned char> smdBytes = GenerateSMD( options );
+    char                       path[]   = "/tmp/smd_bench_XXXXXX";
+    int                        fd       = ::mkstemp( path );
+    if ( fd < 0 or ::write( fd, smdBytes.data(), smdBytes.size() ) != (ssize_t)smdBytes.size() )
+    {
+        std::perror( "Could not write the synthetic SMD" );
+        return EXIT_FAILURE;
+    }
+    ::close( fd );
+
+    SMD smd;
+    if ( smd.Open( path ) != SMD::Status::Ok )
+    {
+        std::fprintf( stderr, "The generated SMD does not parse\n" );
+        ::unlink( path );
+        return EXIT_FAILURE;
+    }
+
+    /* Warm the context up so the stages measure steady state */
+    const std::size_t events = smd.Decode( 1 ).Size();
+    smd.ToMIDI( "/dev/null" );
+
+    /* ToMIDI works on the channels as they play, so its rate counts loop iterations too */
+    std::size_t played = 0;
+    for ( std::size_t c = 0; c < smd.Channels().size(); c++ )
+    {
+        LoopSequencer sequencer = smd.Sequence( c );
+        while ( sequencer.Next().has_value() )
+            played++;
+    }
+
+    std::printf( "%zu bytes, %u channels, %zu opcodes (%zu played), %u iterations\n", smdBytes.size(),
+                 options.channels, events, played, iterations );
+
+    Stage parse{ "parse" }, decode{ "decode" }, midi{ "midi" }, text{ "disassemble" };
+
+    Measure( parse, iterations, smdBytes.size(),
+             [&]() -> std::size_t
+             {
+                 smd.Open( path );
+                 return 0;
+             } );
+    Measure( decode, iterations, smdBytes.size(), [&]() { return smd.Decode( 1 ).Size(); } );
+
+    const EventStream &decoded = smd.Decode( 1 );
+    Measure( midi, iterations, smdBytes.size(),
+             [&]()
+             {
+                 smd.ToMIDI( "/dev/null" );
+                 return played;
+             } );
+
+    /* The disassembler flushes into its file when destroyed, so it has to go before the file is closed */
+    std::FILE *null = std::fopen( "/dev/null", "w" );
+    {
+        Disassembler disassembler( null, Disassembler::Format::Text, 1 << 20 );
+        Measure( text, iterations, smdBytes.size(),
+                 [&]()
+                 {
+                     disassembler.Write( decoded );
+                     return decoded.Size();
+                 } );
+    }
+    std::fclose( null );
+
+    Report( parse, iterations );
+    Report( decode, iterations );
+    Report( midi, iterations );
+    Report( text, iterations );
+
+    ::unlink( path );
+    return EXIT_SUCCESS;
+}
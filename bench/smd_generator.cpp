@@ -0,0 +1,100 @@
+#include "smd_generator.hpp"
+#include <algorithm>
+#include <random>
+
+namespace
+{
+    constexpr std::size_t maxFileSize = 0xFFF0;
+
+    void WriteLE( std::vector<unsigned char> &out, std::size_t at, unsigned int value, std::size_t size )
+    {
+        for ( std::size_t i = 0; i < size; i++ )
+            out[at + i] = ( value >> ( 8 * i ) ) & 0xFF;
+    }
+
+    void GenerateChannel( std::mt19937 &random, unsigned int channel, std::size_t size, std::vector<unsigned char> &out )
+    {
+        auto roll = [&]( unsigned int n ) { return std::uniform_int_distribution<unsigned int>( 0, n - 1 )( random ); };
+
+        std::size_t end = out.size() + size;
+
+        out.insert( out.end(), { 0xBA, 0xAC, (unsigned char)roll( 0x80 ), 0x94, (unsigned char)( 2 + roll( 4 ) ), 0xE0,
+                                 (unsigned char)( 64 + roll( 64 ) ), 0xE8, (unsigned char)roll( 0x80 ) } );
+        if ( channel == 0 )
+            out.insert( out.end(), { 0xA0, (unsigned char)( 80 + roll( 100 ) ) } );
+
+        unsigned int depth = 0;
+
+        /* Leave room for closing loops and the end of channel */
+        while ( out.size() + 16 < end )
+        {
+            unsigned int kind = roll( 100 );
+
+            if ( kind < 70 )
+            {
+                unsigned char note = roll( 13 ) * 0x13 + roll( 0x13 );
+                out.insert( out.end(), { (unsigned char)roll( 0x80 ), note } );
+                if ( note % 0x13 == 0 )
+                    out.push_back( 1 + roll( 0xC0 ) );
+            }
+            else if ( kind < 80 )
+                out.insert( out.end(), { 0x80, (unsigned char)( 1 + roll( 0x60 ) ) } );
+            else if ( kind < 84 )
+                out.insert( out.end(), { 0x81, (unsigned char)( 1 + roll( 0x30 ) ) } );
+            else if ( kind < 88 )
+                out.push_back( roll( 2 ) == 0 ? 0x95 : 0x96 );
+            else if ( kind < 90 and depth < 2 )
+            {
+                out.insert( out.end(), { 0x98, (unsigned char)( 2 + roll( 3 ) ) } );
+                depth++;
+            }
+            else if ( kind < 93 and depth > 0 )
+            {
+                out.push_back( 0x99 );
+                depth--;
+            }
+            else if ( kind < 95 )
+                out.insert( out.end(), { 0xE0, (unsigned char)roll( 0x80 ) } );
+            else if ( kind < 97 )
+                out.insert( out.end(), { 0xC2, (unsigned char)roll( 0x80 ), 0xC4, (unsigned char)roll( 0x80 ) } );
+            else if ( kind < 98 )
+                out.insert( out.end(), { 0xD8, (unsigned char)roll( 0x100 ), (unsigned char)roll( 0x100 ),
+                                         (unsigned char)roll( 0x100 ) } );
+            else
+                out.insert( out.end(), { 0xAC, (unsigned char)roll( 0x80 ) } );
+        }
+
+        while ( depth-- > 0 )
+            out.push_back( 0x99 );
+        out.push_back( 0x90 );
+    }
+} // namespace
+
+std::vector<unsigned char> GenerateSMD( const GeneratorOptions &options )
+{
+    std::mt19937 random( options.seed );
+
+    const unsigned int channels   = std::clamp( options.channels, 1u, 255u );
+    const char         filename[] = "SYNTH.SMD";
+    const std::size_t  headerSize = 0x22 + 2 * ( channels + 1 ) + sizeof( filename );
+
+    std::size_t perChannel = options.bytes_per_channel;
+    perChannel = std::min( perChannel, ( maxFileSize - headerSize ) / channels );
+    perChannel = std::max<std::size_t>( perChannel, 32 );
+
+    std::vector<unsigned char> out( headerSize, 0 );
+    std::copy( std::begin( "smds" ), std::end( "smds" ) - 1, out.begin() );
+    out[0x14] = channels;
+    WriteLE( out, 0x1E, 0x22 + 2 * ( channels + 1 ), 2 );
+    WriteLE( out, 0x20, headerSize, 2 );
+    std::copy( std::begin( filename ), std::end( filename ), out.begin() + 0x22 + 2 * ( channels + 1 ) );
+
+    for ( unsigned int c = 0; c < channels; c++ )
+    {
+        WriteLE( out, 0x22 + 2 * c, out.size(), 2 );
+        GenerateChannel( random, c, perChannel, out );
+    }
+
+    WriteLE( out, 0x08, out.size(), 4 );
+    return out;
+}
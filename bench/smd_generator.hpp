@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct GeneratorOptions
+{
+    unsigned int seed              = 1;
+    unsigned int channels          = 8;
+    std::size_t  bytes_per_channel = 2048;
+};
+
+/*
+ * Builds a valid SMD in memory: identifier, file size, channel offset table
+ * with its zero terminator, null terminated filename, then one channel per
+ * offset with a realistic mix of notes, rests, loops and control opcodes.
+ * The same options always give the same bytes. Channel offsets are 16 bit,
+ * so the total size is capped just below 64 KiB.
+ */
+std::vector<unsigned char> GenerateSMD( const GeneratorOptions &options );
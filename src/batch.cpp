@@ -0,0 +1,241 @@
+#include "batch.hpp"
+#include "event_cache.hpp"
+#include "hash.hpp"
+#include "smd.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+    /*
+     * One deque per worker. Owners pop from the back of their own deque and
+     * idle workers steal from the front of the others'. No task is added once
+     * the pool runs, so a worker is done when every deque is empty.
+     */
+    class WorkStealingQueues
+    {
+    private:
+        struct Queue
+        {
+            std::mutex              mutex;
+            std::deque<std::size_t> tasks;
+        };
+
+        std::vector<Queue> queues;
+
+    public:
+        explicit WorkStealingQueues( std::size_t workers ) : queues( workers )
+        {
+        }
+
+        void Push( std::size_t worker, std::size_t task )
+        {
+            this->queues[worker].tasks.push_back( task );
+        }
+
+        bool Pop( std::size_t worker, std::size_t &task )
+        {
+            {
+                Queue                      &own = this->queues[worker];
+                std::lock_guard<std::mutex> lock( own.mutex );
+                if ( not own.tasks.empty() )
+                {
+                    task = own.tasks.back();
+                    own.tasks.pop_back();
+                    return true;
+                }
+            }
+
+            for ( std::size_t i = 1; i < this->queues.size(); i++ )
+            {
+                Queue                      &victim = this->queues[( worker + i ) % this->queues.size()];
+                std::lock_guard<std::mutex> lock( victim.mutex );
+                if ( not victim.tasks.empty() )
+                {
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    };
+
+    bool IsSMD( const std::filesystem::path &path )
+    {
+        std::string extension = path.extension().string();
+        std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+        return extension == ".smd";
+    }
+
+    std::string OutputFor( const std::string &input, const std::string &output_directory )
+    {
+        std::filesystem::path path( input );
+
+        if ( output_directory.empty() )
+            return path.replace_extension( ".mid" ).string();
+
+        return ( std::filesystem::path( output_directory ) / path.filename().replace_extension( ".mid" ) ).string();
+    }
+
+    void Convert( SMD &smd, BatchResult &result, bool cache, FileReport *report )
+    {
+        std::optional<ReportScope> scope;
+        if ( report != nullptr )
+            scope.emplace( *report );
+
+        SMD::Status status = smd.Open( result.input );
+
+        std::string   cachePath = std::filesystem::path( result.output ).replace_extension( ".smdc" ).string();
+        std::uint64_t hash      = 0;
+
+        if ( status == SMD::Status::Ok and cache )
+        {
+            hash = ContentHash( smd.Bytes() );
+
+            EventCache      existing;
+            std::error_code error;
+            if ( existing.Open( cachePath ) and existing.Matches( hash, smd.Bytes().size() ) and
+                 std::filesystem::exists( result.output, error ) )
+            {
+                result.ok     = true;
+                result.cached = true;
+                return;
+            }
+        }
+
+        if ( status == SMD::Status::Ok )
+            status = smd.ToMIDI( result.output );
+
+        /* The decoded events are only needed for the cache and the opcode counts */
+        if ( status == SMD::Status::Ok and ( cache or report != nullptr ) )
+        {
+            const EventStream &events = smd.Decode( 1 );
+            CountOpcodes( events );
+
+            /* A cache that cannot be written only costs a decode next time */
+            if ( cache )
+                EventCache::Write( cachePath, events, hash, smd.Bytes().size() );
+        }
+
+        result.ok = status == SMD::Status::Ok;
+        if ( not result.ok )
+            result.error = SMD::Describe( status );
+    }
+} // namespace
+
+std::vector<std::string> CollectInputs( const std::vector<std::string> &paths )
+{
+    std::vector<std::string> inputs;
+
+    for ( const auto &path : paths )
+    {
+        std::error_code error;
+        if ( not std::filesystem::is_directory( path, error ) )
+        {
+            inputs.push_back( path );
+            continue;
+        }
+
+        std::vector<std::string> found;
+        for ( const auto &entry : std::filesystem::directory_iterator( path, error ) )
+        {
+            if ( entry.is_regular_file( error ) and IsSMD( entry.path() ) )
+                found.push_back( entry.path().string() );
+        }
+
+        std::sort( found.begin(), found.end() );
+        inputs.insert( inputs.end(), found.begin(), found.end() );
+    }
+
+    return inputs;
+}
+
+std::vector<BatchResult> ConvertBatch( const std::vector<std::string> &inputs,
+                                       const std::string              &output_directory,
+                                       unsigned int                    threads,
+                                       bool                            cache,
+                                       std::vector<FileReport>        *reports )
+{
+    std::vector<BatchResult> results( inputs.size() );
+    if ( reports != nullptr )
+    {
+        reports->assign( inputs.size(), FileReport{} );
+        for ( std::size_t i = 0; i < inputs.size(); i++ )
+            ( *reports )[i].input = inputs[i];
+    }
+
+    /*
+     * Inputs with the same name from different directories would write the
+     * same output at the same time. The first one keeps it, the others fail.
+     */
+    std::unordered_map<std::string, std::size_t> owners;
+    std::vector<std::size_t>                     order;
+    order.reserve( inputs.size() );
+
+    for ( std::size_t i = 0; i < inputs.size(); i++ )
+    {
+        results[i].input  = inputs[i];
+        results[i].output = OutputFor( inputs[i], output_directory );
+
+        auto [owner, inserted] = owners.emplace( std::filesystem::path( results[i].output ).lexically_normal(), i );
+        if ( inserted )
+            order.push_back( i );
+        else
+            results[i].error = "Same output file as " + inputs[owner->second];
+    }
+
+    if ( not output_directory.empty() )
+    {
+        std::error_code error;
+        std::filesystem::create_directories( output_directory, error );
+    }
+
+    if ( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    threads = std::min<std::size_t>( threads, std::max<std::size_t>( order.size(), 1 ) );
+
+    /* Deal the biggest files out first so no worker is left with a long tail */
+    std::vector<std::uintmax_t> sizes( inputs.size() );
+    for ( std::size_t i : order )
+    {
+        std::error_code error;
+        sizes[i] = std::filesystem::file_size( inputs[i], error );
+        if ( error )
+            sizes[i] = 0;
+    }
+    std::stable_sort( order.begin(), order.end(), [&]( std::size_t a, std::size_t b ) { return sizes[a] > sizes[b]; } );
+
+    WorkStealingQueues queues( threads );
+    for ( std::size_t i = 0; i < order.size(); i++ )
+        queues.Push( i % threads, order[order.size() - 1 - i] );
+
+    /* Each worker reuses one decoder context for all the files it converts */
+    auto worker = [&]( std::size_t id )
+    {
+        SMD         smd;
+        std::size_t task;
+        while ( queues.Pop( id, task ) )
+            Convert( smd, results[task], cache, reports != nullptr ? &( *reports )[task] : nullptr );
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve( threads - 1 );
+    for ( std::size_t i = 1; i < threads; i++ )
+        pool.emplace_back( worker, i );
+
+    worker( 0 );
+
+    for ( auto &thread : pool )
+        thread.join();
+
+    return results;
+}
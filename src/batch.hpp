@@ -0,0 +1,36 @@
+#pragma once
+
+#include "instrumentation.hpp"
+#include <string>
+#include <vector>
+
+struct BatchResult
+{
+    std::string input;
+    std::string output;
+    std::string error;
+    bool        ok     = false;
+    /* Skipped because the event cache next to the output matched the input */
+    bool        cached = false;
+};
+
+/* Expands directories into the .smd files they contain, files are kept as they are */
+std::vector<std::string> CollectInputs( const std::vector<std::string> &paths );
+
+/*
+ * Converts every input to MIDI on a work-stealing pool of `threads` workers
+ * (0 = one per hardware thread). Outputs go to output_directory, or next to
+ * their input when it is empty. A failing file only fails its own result.
+ * When several inputs map to the same output, only the first is converted.
+ * Results are returned in input order. When `reports` is given it gets one
+ * FileReport per input, filled in builds with SMD_ENABLE_STATS.
+ *
+ * With `cache`, an EventCache is kept next to every output (.smdc), and an
+ * input whose hash matches its cache is not converted again as long as its
+ * MIDI file still exists.
+ */
+std::vector<BatchResult> ConvertBatch( const std::vector<std::string> &inputs,
+                                       const std::string              &output_directory,
+                                       unsigned int                    threads = 0,
+                                       bool                            cache   = false,
+                                       std::vector<FileReport>        *reports = nullptr );
@@ -0,0 +1,438 @@
+#include "daemon.hpp"
+#include "disassembler.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "midi_writer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <poll.h>
+#include <sstream>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    void RequestStop( int )
+    {
+        stopRequested = 1;
+    }
+
+    constexpr std::size_t maxRequestLength = 4096;
+
+    /*
+     * How long a client gets to send its request line, and to take each
+     * part of the reply. Workers are few, so a client that connects and
+     * then stalls must not keep one forever.
+     */
+    constexpr std::chrono::milliseconds requestTimeout( 2000 );
+    constexpr std::chrono::milliseconds replyTimeout( 10000 );
+
+    /* Reads up to the first newline, whatever follows it is ignored */
+    bool ReadRequest( int client, std::string &line )
+    {
+        const auto deadline = std::chrono::steady_clock::now() + requestTimeout;
+        char       buffer[maxRequestLength];
+
+        while ( line.size() < maxRequestLength )
+        {
+            auto now = std::chrono::steady_clock::now();
+            if ( now >= deadline )
+                return false;
+
+            pollfd readable{ client, POLLIN, 0 };
+            int    wait   = std::chrono::ceil<std::chrono::milliseconds>( deadline - now ).count();
+            int    polled = poll( &readable, 1, wait );
+            if ( polled < 0 and errno == EINTR )
+                continue;
+            if ( polled <= 0 )
+                return false;
+
+            ssize_t got = recv( client, buffer, maxRequestLength - line.size(), 0 );
+            if ( got < 0 and errno == EINTR )
+                continue;
+            if ( got <= 0 )
+                return not line.empty();
+
+            std::size_t scanned = line.size();
+            line.append( buffer, got );
+
+            std::size_t newline = line.find( '\n', scanned );
+            if ( newline != std::string::npos )
+            {
+                line.resize( newline );
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*
+     * Removes what is at `path` only if it is a socket, such as one left by
+     * a previous run. Anything else there is kept, and the call fails: a
+     * mistyped command line must not delete a regular file.
+     */
+    bool RemoveSocket( const std::string &path )
+    {
+        struct stat status;
+        if ( lstat( path.c_str(), &status ) != 0 )
+            return errno == ENOENT;
+
+        if ( not S_ISSOCK( status.st_mode ) )
+            return false;
+
+        return unlink( path.c_str() ) == 0 or errno == ENOENT;
+    }
+
+    bool SendAll( int client, std::string_view text )
+    {
+        while ( not text.empty() )
+        {
+            ssize_t sent = send( client, text.data(), text.size(), MSG_NOSIGNAL );
+            if ( sent < 0 and errno == EINTR )
+                continue;
+            if ( sent <= 0 )
+                return false;
+            text.remove_prefix( sent );
+        }
+
+        return true;
+    }
+
+    std::vector<std::string> SplitFields( const std::string &line )
+    {
+        std::vector<std::string> fields;
+        std::size_t              begin = 0;
+
+        for ( std::size_t end; ( end = line.find( '\t', begin ) ) != std::string::npos; begin = end + 1 )
+            fields.push_back( line.substr( begin, end - begin ) );
+
+        fields.push_back( line.substr( begin ) );
+
+        if ( not fields.empty() and not fields.back().empty() and fields.back().back() == '\r' )
+            fields.back().pop_back();
+
+        return fields;
+    }
+
+    std::string FormatHeader( const SMD &smd )
+    {
+        const SMD::Header &h = smd.GetHeader();
+        std::ostringstream out;
+
+        out << "Filename: " << h.filename << '\n';
+        out << "File size: " << h.file_size << '\n';
+        out << "Number of channels: " << (unsigned int)h.number_of_channels << '\n';
+        out << "Offset to filename: " << h.offset_of_filename << '\n';
+        out << "Offset to data chunk: " << h.offset_of_data_chunk << '\n';
+
+        for ( std::size_t i = 0; i < h.offset_of_channel_n.size(); i++ )
+            out << "Offset to channel " << i << ": " << h.offset_of_channel_n[i] << '\n';
+
+        return out.str();
+    }
+} // namespace
+
+std::size_t CachedSong::Footprint() const
+{
+    const EventStream &e = this->events;
+
+    return sizeof( CachedSong ) + this->bytes.capacity() + e.opcode.capacity() + e.num_parameters.capacity() +
+           e.parameters.capacity() * sizeof( e.parameters[0] ) + e.channel.capacity() +
+           e.tick.capacity() * sizeof( unsigned int ) + e.channel_begin.capacity() * sizeof( std::size_t ) +
+           e.channel_length.capacity() * sizeof( unsigned int ) +
+           this->smd.Channels().capacity() * sizeof( std::span<const unsigned char> );
+}
+
+SongCache::SongCache( std::size_t capacity ) : capacity( capacity )
+{
+}
+
+std::shared_ptr<const CachedSong> SongCache::Find( std::uint64_t key, std::span<const unsigned char> bytes )
+{
+    std::lock_guard<std::mutex> lock( this->mutex );
+
+    auto found = this->entries.find( key );
+    if ( found == this->entries.end() )
+        return nullptr;
+
+    /* A hash collision must not hand out another song */
+    const CachedSong &song = *found->second->second;
+    if ( not std::equal( bytes.begin(), bytes.end(), song.bytes.begin(), song.bytes.end() ) )
+        return nullptr;
+
+    this->order.splice( this->order.begin(), this->order, found->second );
+    return found->second->second;
+}
+
+void SongCache::Insert( std::uint64_t key, std::shared_ptr<const CachedSong> song )
+{
+    std::size_t footprint = song->Footprint();
+    if ( footprint > this->capacity )
+        return;
+
+    std::lock_guard<std::mutex> lock( this->mutex );
+
+    auto found = this->entries.find( key );
+    if ( found != this->entries.end() )
+    {
+        this->used -= found->second->second->Footprint();
+        this->order.erase( found->second );
+        this->entries.erase( found );
+    }
+
+    while ( this->used + footprint > this->capacity and not this->order.empty() )
+    {
+        this->used -= this->order.back().second->Footprint();
+        this->entries.erase( this->order.back().first );
+        this->order.pop_back();
+    }
+
+    this->order.emplace_front( key, std::move( song ) );
+    this->entries[key] = this->order.begin();
+    this->used += footprint;
+}
+
+ConversionDaemon::ConversionDaemon( std::string socket_path, unsigned int workers, std::size_t cache_bytes )
+    : socketPath( std::move( socket_path ) ), workers( workers ), cache( cache_bytes )
+{
+    if ( this->workers == 0 )
+        this->workers = std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+std::shared_ptr<const CachedSong> ConversionDaemon::Load( const std::string &input, std::string &error )
+{
+    MappedFile file;
+    if ( not file.Open( input ) )
+    {
+        std::error_code missing;
+        bool            exists = std::filesystem::exists( input, missing );
+        error = SMD::Describe( exists ? SMD::Status::CannotMapFile : SMD::Status::FileNotFound );
+        return nullptr;
+    }
+
+    std::span<const unsigned char> bytes = file.Bytes();
+    std::uint64_t                  key   = ContentHash( bytes );
+
+    if ( auto song = this->cache.Find( key, bytes ) )
+        return song;
+
+    /* The song keeps its own copy, so later edits to the file cannot change a cached entry */
+    auto song = std::make_shared<CachedSong>();
+    song->bytes.assign( bytes.begin(), bytes.end() );
+
+    SMD::Status status = song->smd.Load( std::as_bytes( std::span( song->bytes ) ) );
+    if ( status != SMD::Status::Ok )
+    {
+        error = SMD::Describe( status );
+        return nullptr;
+    }
+
+    song->smd.Decode( song->events, 1 );
+    this->cache.Insert( key, song );
+    return song;
+}
+
+void ConversionDaemon::Serve( int client, std::vector<MidiTrack> &tracks, OpcodeScanner &scanner )
+{
+    std::string line;
+    if ( not ReadRequest( client, line ) )
+    {
+        SendAll( client, "ERROR Request too long, incomplete or too slow\n" );
+        return;
+    }
+
+    std::vector<std::string> fields  = SplitFields( line );
+    const std::string       &command = fields[0];
+
+    if ( fields.size() < 2 or ( command != "midi" and command != "disasm" and command != "stats" and
+                                command != "header" ) )
+    {
+        SendAll( client, "ERROR Unknown request\n" );
+        return;
+    }
+
+    Disassembler::Format format = Disassembler::Format::Text;
+    if ( ( command == "midi" and fields.size() != 3 ) or
+         ( command == "disasm" and fields.size() > 2 and not Disassembler::ParseFormat( fields[2], format ) ) )
+    {
+        SendAll( client, "ERROR Bad arguments\n" );
+        return;
+    }
+
+    std::string error;
+    auto        song = this->Load( fields[1], error );
+    if ( not song )
+    {
+        SendAll( client, "ERROR " + error + '\n' );
+        return;
+    }
+
+    if ( command == "header" )
+    {
+        SendAll( client, "OK\n" + FormatHeader( song->smd ) );
+    }
+    else if ( command == "stats" )
+    {
+        std::ostringstream out;
+        PrintSummary( out, scanner.Scan( song->smd ) );
+        SendAll( client, "OK\n" + out.str() );
+    }
+    else if ( command == "midi" )
+    {
+        SMD::Status status = SMD::Status::Ok;
+        if ( not BuildTracks( song->smd, tracks ) )
+            status = SMD::Status::ExpansionLimit;
+        else if ( not WriteMidiFile( fields[2],
+                                     std::span<const MidiTrack>( tracks.data(), song->smd.Channels().size() + 1 ) ) )
+            status = SMD::Status::CannotWriteOutput;
+
+        if ( status == SMD::Status::Ok )
+            SendAll( client, "OK\n" );
+        else
+            SendAll( client, "ERROR " + std::string( SMD::Describe( status ) ) + '\n' );
+    }
+    else if ( SendAll( client, "OK\n" ) )
+    {
+        int         copy   = dup( client );
+        std::FILE  *output = copy < 0 ? nullptr : fdopen( copy, "w" );
+        if ( output == nullptr )
+        {
+            if ( copy >= 0 )
+                close( copy );
+            return;
+        }
+
+        {
+            Disassembler disassembler( output, format );
+            disassembler.Write( song->events );
+        }
+
+        std::fclose( output );
+    }
+}
+
+bool ConversionDaemon::Run()
+{
+    sockaddr_un address{};
+    if ( this->socketPath.size() >= sizeof( address.sun_path ) )
+        return false;
+
+    address.sun_family = AF_UNIX;
+    std::memcpy( address.sun_path, this->socketPath.c_str(), this->socketPath.size() + 1 );
+
+    int listener = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( listener < 0 )
+        return false;
+
+    /* A socket file left over by a previous run would make bind() fail */
+    if ( not RemoveSocket( this->socketPath ) )
+    {
+        close( listener );
+        return false;
+    }
+
+    /*
+     * Requests read and write files with the daemon's rights, so only its
+     * owner may connect. The socket is created 0600 rather than chmod-ed
+     * afterwards, which would leave a window. No other thread runs yet, so
+     * changing the process umask here is safe.
+     */
+    mode_t previous = umask( 0177 );
+    int    bound    = bind( listener, reinterpret_cast<const sockaddr *>( &address ), sizeof( address ) );
+    umask( previous );
+
+    if ( bound != 0 or listen( listener, 128 ) != 0 )
+    {
+        close( listener );
+        return false;
+    }
+
+    /* Clients that hang up early must not kill the daemon */
+    std::signal( SIGPIPE, SIG_IGN );
+    stopRequested = 0;
+    std::signal( SIGINT, RequestStop );
+    std::signal( SIGTERM, RequestStop );
+
+    std::mutex              mutex;
+    std::condition_variable ready;
+    std::deque<int>         clients;
+    std::atomic<bool>       stopping = false;
+
+    auto worker = [&]()
+    {
+        std::vector<MidiTrack> tracks;
+        OpcodeScanner          scanner;
+
+        while ( true )
+        {
+            int client;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                ready.wait( lock, [&] { return stopping or not clients.empty(); } );
+                if ( clients.empty() )
+                    return;
+                client = clients.front();
+                clients.pop_front();
+            }
+
+            this->Serve( client, tracks, scanner );
+            close( client );
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve( this->workers );
+    for ( unsigned int i = 0; i < this->workers; i++ )
+        pool.emplace_back( worker );
+
+    /* Polled with a timeout so a signal landing on a worker thread still stops the loop */
+    while ( stopRequested == 0 )
+    {
+        pollfd incoming{ listener, POLLIN, 0 };
+        if ( poll( &incoming, 1, 100 ) <= 0 )
+            continue;
+
+        int client = accept4( listener, nullptr, nullptr, SOCK_CLOEXEC );
+        if ( client < 0 )
+            continue;
+
+        /* A client that stops reading its reply makes the send fail instead of blocking the worker */
+        timeval sendTimeout{ replyTimeout.count() / 1000, ( replyTimeout.count() % 1000 ) * 1000 };
+        setsockopt( client, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof( sendTimeout ) );
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            clients.push_back( client );
+        }
+        ready.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stopping = true;
+    }
+    ready.notify_all();
+
+    for ( auto &thread : pool )
+        thread.join();
+
+    close( listener );
+    RemoveSocket( this->socketPath );
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "events.hpp"
+#include "smd.hpp"
+#include "statistics.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* A parsed and decoded song. The SMD borrows `bytes`, so a song is never copied or moved once built */
+struct CachedSong
+{
+    std::vector<unsigned char> bytes;
+    SMD                        smd;
+    EventStream                events;
+
+    std::size_t Footprint() const;
+};
+
+/*
+ * Least recently used songs, keyed by the hash of their contents and bounded
+ * by the memory they take. Songs are shared, so one evicted while a request
+ * still uses it stays alive until that request is done.
+ */
+class SongCache
+{
+private:
+    using Entry = std::pair<std::uint64_t, std::shared_ptr<const CachedSong>>;
+
+    std::list<Entry>                                              order;
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> entries;
+    std::mutex                                                    mutex;
+    std::size_t                                                   capacity = 0;
+    std::size_t                                                   used     = 0;
+
+public:
+    explicit SongCache( std::size_t capacity );
+
+    /* Returns nullptr unless a song with this hash and exactly these bytes is cached */
+    std::shared_ptr<const CachedSong> Find( std::uint64_t key, std::span<const unsigned char> bytes );
+    void                              Insert( std::uint64_t key, std::shared_ptr<const CachedSong> song );
+};
+
+/*
+ * Serves conversions over a Unix domain socket, so tools that convert the
+ * same songs again and again only pay for the decode once. A request is one
+ * line of tab separated fields, and the connection is closed after the reply:
+ *
+ *     midi    <file.smd> <output.mid>
+ *     disasm  <file.smd> [text|csv|json]
+ *     stats   <file.smd>
+ *     header  <file.smd>
+ *
+ * The reply starts with "OK" or "ERROR <reason>" on its own line, followed
+ * by the output of the command. The socket is only accessible to the user
+ * running the daemon, since requests name files it reads and writes.
+ */
+class ConversionDaemon
+{
+private:
+    std::string  socketPath;
+    unsigned int workers;
+    SongCache    cache;
+
+    std::shared_ptr<const CachedSong> Load( const std::string &input, std::string &error );
+    void Serve( int client, std::vector<MidiTrack> &tracks, OpcodeScanner &scanner );
+
+public:
+    /* workers = 0 uses one per hardware thread */
+    ConversionDaemon( std::string socket_path, unsigned int workers = 0, std::size_t cache_bytes = 64 << 20 );
+
+    /*
+     * Blocks until SIGINT or SIGTERM. Returns false if the socket could not
+     * be set up, which includes its path being taken by anything but a socket.
+     */
+    bool Run();
+};
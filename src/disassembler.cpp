@@ -0,0 +1,213 @@
+#include "disassembler.hpp"
+#include "instruments.hpp"
+#include "opcodes.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    /* Longest line a single event can produce, in any format */
+    constexpr std::size_t maxLineLength = 512;
+
+    std::string_view Trimmed( std::string_view text )
+    {
+        while ( not text.empty() and text.back() == ' ' )
+            text.remove_suffix( 1 );
+        return text;
+    }
+} // namespace
+
+Disassembler::Disassembler( std::FILE *output, Format format, std::size_t capacity )
+    : buffer( std::max( capacity, 2 * maxLineLength ) ), output( output ), format( format )
+{
+}
+
+Disassembler::~Disassembler()
+{
+    this->Flush();
+}
+
+bool Disassembler::Flush()
+{
+    if ( this->used > 0 and std::fwrite( this->buffer.data(), 1, this->used, this->output ) != this->used )
+        this->failed = true;
+
+    this->used = 0;
+    return not this->failed and std::fflush( this->output ) == 0;
+}
+
+void Disassembler::Put( std::string_view text )
+{
+    std::memcpy( this->buffer.data() + this->used, text.data(), text.size() );
+    this->used += text.size();
+}
+
+void Disassembler::PutHex( unsigned int value )
+{
+    static constexpr char digits[] = "0123456789abcdef";
+
+    char        reversed[8];
+    std::size_t count = 0;
+
+    do
+    {
+        reversed[count++] = digits[value & 0xF];
+        value >>= 4;
+    } while ( value != 0 );
+
+    this->Put( '0' );
+    this->Put( 'x' );
+    while ( count > 0 )
+        this->Put( reversed[--count] );
+}
+
+void Disassembler::PutDecimal( unsigned int value )
+{
+    char        reversed[10];
+    std::size_t count = 0;
+
+    do
+    {
+        reversed[count++] = '0' + value % 10;
+        value /= 10;
+    } while ( value != 0 );
+
+    while ( count > 0 )
+        this->Put( reversed[--count] );
+}
+
+void Disassembler::Write( const EventStream &events )
+{
+    if ( this->format == Format::Quiet )
+        return;
+
+    if ( this->format == Format::CSV )
+    {
+        this->Ensure( maxLineLength );
+        this->Put( "channel,tick,opcode,message,parameters\n" );
+    }
+
+    for ( std::size_t i = 0; i < events.Size(); i++ )
+    {
+        this->Ensure( maxLineLength );
+
+        switch ( this->format )
+        {
+        case Format::Text:
+            this->WriteText( events, i );
+            break;
+        case Format::CSV:
+            this->WriteCSV( events, i );
+            break;
+        case Format::JSONLines:
+            this->WriteJSON( events, i );
+            break;
+        case Format::Quiet:
+            break;
+        }
+    }
+}
+
+void Disassembler::WriteText( const EventStream &events, std::size_t i )
+{
+    const unsigned char                 code           = events.opcode[i];
+    const unsigned char                 num_parameters = events.num_parameters[i];
+    const std::array<unsigned char, 3> &parameters     = events.parameters[i];
+    const Opcode                       &opcode         = opcodes[code];
+
+    this->Put( '[' );
+    this->PutHex( code );
+    this->Put( "]: " );
+    this->Put( opcode.message );
+
+    switch ( opcode.kind )
+    {
+    case OpcodeKind::Note:
+        if ( num_parameters > 0 )
+        {
+            this->PutHex( parameters[0] );
+            if ( num_parameters > 1 )
+            {
+                this->Put( ' ' );
+                this->PutHex( parameters[1] );
+            }
+        }
+        break;
+    case OpcodeKind::Instrument:
+        if ( num_parameters > 0 )
+        {
+            this->PutHex( parameters[0] );
+            this->Put( " Instrument = " );
+            this->Put( instrumentNames[parameters[0]] );
+        }
+        break;
+    default:
+        for ( unsigned int p = 0; p < num_parameters; p++ )
+        {
+            this->PutHex( parameters[p] );
+            this->Put( ' ' );
+        }
+        break;
+    }
+
+    this->Put( '\n' );
+}
+
+void Disassembler::WriteCSV( const EventStream &events, std::size_t i )
+{
+    this->PutDecimal( events.channel[i] );
+    this->Put( ',' );
+    this->PutDecimal( events.tick[i] );
+    this->Put( ',' );
+    this->PutHex( events.opcode[i] );
+    this->Put( ",\"" );
+    this->Put( Trimmed( opcodes[events.opcode[i]].message ) );
+    this->Put( "\"," );
+
+    for ( unsigned int p = 0; p < events.num_parameters[i]; p++ )
+    {
+        if ( p > 0 )
+            this->Put( ' ' );
+        this->PutHex( events.parameters[i][p] );
+    }
+
+    this->Put( '\n' );
+}
+
+void Disassembler::WriteJSON( const EventStream &events, std::size_t i )
+{
+    this->Put( "{\"channel\":" );
+    this->PutDecimal( events.channel[i] );
+    this->Put( ",\"tick\":" );
+    this->PutDecimal( events.tick[i] );
+    this->Put( ",\"opcode\":" );
+    this->PutDecimal( events.opcode[i] );
+    this->Put( ",\"message\":\"" );
+    this->Put( Trimmed( opcodes[events.opcode[i]].message ) );
+    this->Put( "\",\"parameters\":[" );
+
+    for ( unsigned int p = 0; p < events.num_parameters[i]; p++ )
+    {
+        if ( p > 0 )
+            this->Put( ',' );
+        this->PutDecimal( events.parameters[i][p] );
+    }
+
+    this->Put( "]}\n" );
+}
+
+bool Disassembler::ParseFormat( std::string_view name, Format &format )
+{
+    if ( name == "text" )
+        format = Format::Text;
+    else if ( name == "csv" )
+        format = Format::CSV;
+    else if ( name == "json" )
+        format = Format::JSONLines;
+    else if ( name == "quiet" )
+        format = Format::Quiet;
+    else
+        return false;
+
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "events.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+/*
+ * Formats an EventStream into a reusable buffer that is handed to the
+ * output in large blocks, instead of one stdio call per operand.
+ */
+class Disassembler
+{
+public:
+    enum class Format
+    {
+        Text,
+        CSV,
+        JSONLines,
+        Quiet
+    };
+
+private:
+    std::vector<char> buffer;
+    std::size_t       used   = 0;
+    std::FILE        *output = nullptr;
+    Format            format = Format::Text;
+    bool              failed = false;
+
+    inline void Ensure( std::size_t bytes )
+    {
+        if ( this->used + bytes > this->buffer.size() )
+            this->Flush();
+    }
+
+    inline void Put( char c )
+    {
+        this->buffer[this->used++] = c;
+    }
+
+    void Put( std::string_view text );
+    void PutHex( unsigned int value );
+    void PutDecimal( unsigned int value );
+
+    void WriteText( const EventStream &events, std::size_t i );
+    void WriteCSV( const EventStream &events, std::size_t i );
+    void WriteJSON( const EventStream &events, std::size_t i );
+
+public:
+    explicit Disassembler( std::FILE *output = stdout, Format format = Format::Text, std::size_t capacity = 1 << 16 );
+    ~Disassembler();
+
+    void Write( const EventStream &events );
+
+    /* Returns false if any write to the output failed */
+    bool Flush();
+
+    static bool ParseFormat( std::string_view name, Format &format );
+};
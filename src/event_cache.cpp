@@ -0,0 +1,237 @@
+#include "event_cache.hpp"
+#include "opcodes.hpp"
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/* The sections are used in place, which only works where the file's byte order is the host's */
+static_assert( std::endian::native == std::endian::little, "EventCache maps little endian files directly" );
+static_assert( sizeof( EventCache::Header ) == 48 and sizeof( EventCache::Channel ) == 16 and
+               sizeof( EventCache::TableEntry ) == 16 );
+
+namespace
+{
+    constexpr char magic[8] = { 's', 'm', 'd', 'e', 'v', 'e', 'n', 't' };
+
+    constexpr std::size_t Align( std::size_t offset )
+    {
+        return ( offset + 7 ) & ~std::size_t( 7 );
+    }
+
+    /* Byte offsets of every section, shared by the reader and the writer */
+    struct Layout
+    {
+        std::size_t index, ticks, opcodes, numParameters, parameters, tempos, instruments, end;
+
+        explicit Layout( const EventCache::Header &h )
+        {
+            std::size_t events = h.events;
+
+            this->index         = Align( sizeof( EventCache::Header ) );
+            this->ticks         = Align( this->index + h.channels * sizeof( EventCache::Channel ) );
+            this->opcodes       = Align( this->ticks + events * sizeof( std::uint32_t ) );
+            this->numParameters = Align( this->opcodes + events );
+            this->parameters    = Align( this->numParameters + events );
+            this->tempos        = Align( this->parameters + 3 * events );
+            this->instruments   = Align( this->tempos + h.tempo_count * sizeof( EventCache::TableEntry ) );
+            this->end           = this->instruments + h.instrument_count * sizeof( EventCache::TableEntry );
+        }
+    };
+
+    template <typename T>
+    std::span<const T> Section( std::span<const unsigned char> bytes, std::size_t at, std::size_t count )
+    {
+        return { reinterpret_cast<const T *>( bytes.data() + at ), count };
+    }
+
+    template <typename T>
+    void Put( std::vector<unsigned char> &out, std::size_t at, const T *values, std::size_t count )
+    {
+        if ( count > 0 )
+            std::memcpy( out.data() + at, values, count * sizeof( T ) );
+    }
+} // namespace
+
+bool EventCache::Open( const std::string &filename )
+{
+    this->Close();
+
+    if ( not this->file.Open( filename ) )
+        return false;
+
+    std::span<const unsigned char> bytes = this->file.Bytes();
+    Header                         h;
+
+    if ( bytes.size() < sizeof( Header ) )
+    {
+        this->Close();
+        return false;
+    }
+
+    std::memcpy( &h, bytes.data(), sizeof( Header ) );
+
+    /* Counts are checked before the layout is computed from them, so it cannot overflow */
+    if ( std::memcmp( h.magic, magic, sizeof( magic ) ) != 0 or h.version != version or
+         h.channels > bytes.size() or h.events > bytes.size() or h.tempo_count > bytes.size() or
+         h.instrument_count > bytes.size() or Layout( h ).end != bytes.size() )
+    {
+        this->Close();
+        return false;
+    }
+
+    Layout layout( h );
+
+    this->header        = reinterpret_cast<const Header *>( bytes.data() );
+    this->index         = Section<Channel>( bytes, layout.index, h.channels );
+    this->ticks         = Section<std::uint32_t>( bytes, layout.ticks, h.events );
+    this->opcodes       = Section<unsigned char>( bytes, layout.opcodes, h.events );
+    this->numParameters = Section<unsigned char>( bytes, layout.numParameters, h.events );
+    this->parameters    = Section<std::array<unsigned char, 3>>( bytes, layout.parameters, h.events );
+    this->tempos        = Section<TableEntry>( bytes, layout.tempos, h.tempo_count );
+    this->instruments   = Section<TableEntry>( bytes, layout.instruments, h.instrument_count );
+
+    if ( not this->ContentsValid() )
+    {
+        this->Close();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Everything consumers take on trust: the index and the tables stay inside
+ * the arrays, parameter counts fit their array, and every channel's ticks
+ * never go back.
+ */
+bool EventCache::ContentsValid() const
+{
+    const std::size_t events = this->ticks.size();
+
+    /* EventStream numbers channels with a byte, and an SMD never has more than 255 of them */
+    if ( this->index.size() > 0xFF )
+        return false;
+
+    for ( const Channel &channel : this->index )
+    {
+        if ( channel.first_event > events or channel.event_count > events - channel.first_event )
+            return false;
+
+        const std::size_t end = channel.first_event + channel.event_count;
+        for ( std::size_t i = channel.first_event + 1; i < end; i++ )
+        {
+            if ( this->ticks[i] < this->ticks[i - 1] )
+                return false;
+        }
+    }
+
+    for ( unsigned char count : this->numParameters )
+    {
+        if ( count > 3 )
+            return false;
+    }
+
+    for ( auto table : { this->tempos, this->instruments } )
+    {
+        for ( const TableEntry &entry : table )
+        {
+            if ( entry.channel >= this->index.size() or entry.event >= events )
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void EventCache::Close()
+{
+    this->file.Close();
+    this->header        = nullptr;
+    this->index         = {};
+    this->ticks         = {};
+    this->opcodes       = {};
+    this->numParameters = {};
+    this->parameters    = {};
+    this->tempos        = {};
+    this->instruments   = {};
+}
+
+bool EventCache::Write( const std::string &filename,
+                        const EventStream &events,
+                        std::uint64_t      source_hash,
+                        std::uint64_t      source_size )
+{
+    std::vector<TableEntry> tempos, instruments;
+    for ( std::size_t c = 0; c < events.Channels(); c++ )
+    {
+        for ( std::size_t i = events.channel_begin[c]; i < events.channel_begin[c + 1]; i++ )
+        {
+            const OpcodeKind kind = ::opcodes[events.opcode[i]].kind;
+            if ( events.num_parameters[i] == 0 or ( kind != OpcodeKind::Tempo and kind != OpcodeKind::Instrument ) )
+                continue;
+
+            TableEntry entry{ (std::uint32_t)c, (std::uint32_t)i, events.tick[i], events.parameters[i][0] };
+            ( kind == OpcodeKind::Tempo ? tempos : instruments ).push_back( entry );
+        }
+    }
+
+    Header h{};
+    std::memcpy( h.magic, magic, sizeof( magic ) );
+    h.version          = version;
+    h.channels         = events.Channels();
+    h.source_hash      = source_hash;
+    h.source_size      = source_size;
+    h.events           = events.Size();
+    h.tempo_count      = tempos.size();
+    h.instrument_count = instruments.size();
+
+    std::vector<Channel> index( events.Channels() );
+    for ( std::size_t c = 0; c < events.Channels(); c++ )
+        index[c] = Channel{ (std::uint32_t)events.channel_begin[c],
+                            (std::uint32_t)( events.channel_begin[c + 1] - events.channel_begin[c] ),
+                            events.channel_length[c], 0 };
+
+    Layout                     layout( h );
+    std::vector<unsigned char> out( layout.end, 0 );
+
+    Put( out, 0, &h, 1 );
+    Put( out, layout.index, index.data(), index.size() );
+    Put( out, layout.ticks, events.tick.data(), events.Size() );
+    Put( out, layout.opcodes, events.opcode.data(), events.Size() );
+    Put( out, layout.numParameters, events.num_parameters.data(), events.Size() );
+    Put( out, layout.parameters, events.parameters.data(), events.Size() );
+    Put( out, layout.tempos, tempos.data(), tempos.size() );
+    Put( out, layout.instruments, instruments.data(), instruments.size() );
+
+    const std::string temporary = filename + ".tmp";
+    std::FILE        *file      = std::fopen( temporary.c_str(), "wb" );
+    if ( file == nullptr )
+        return false;
+
+    bool written = std::fwrite( out.data(), 1, out.size(), file ) == out.size();
+    written      = std::fclose( file ) == 0 and written;
+
+    if ( not written or std::rename( temporary.c_str(), filename.c_str() ) != 0 )
+    {
+        std::remove( temporary.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+void EventCache::ToEventStream( EventStream &events ) const
+{
+    events.Clear();
+    events.Reserve( this->ticks.size(), this->index.size() );
+
+    for ( std::size_t c = 0; c < this->index.size(); c++ )
+    {
+        const Channel &channel = this->index[c];
+        for ( std::size_t i = channel.first_event; i < channel.first_event + channel.event_count; i++ )
+            events.Push( this->opcodes[i], this->numParameters[i], this->parameters[i], c, this->ticks[i] );
+
+        events.EndChannel( channel.length );
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "events.hpp"
+#include "mapped_file.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+/*
+ * On-disk copy of a decoded EventStream that consumers map and read in
+ * place, without going through the opcode table again. All fields are
+ * little endian and every section starts 8-byte aligned:
+ *
+ *     Header
+ *     Channel      index[channels]
+ *     uint32       tick[events]
+ *     uint8        opcode[events]
+ *     uint8        num_parameters[events]
+ *     uint8        parameters[events][3]
+ *     TableEntry   tempos[tempo_count]
+ *     TableEntry   instruments[instrument_count]
+ *
+ * The header carries the hash and size of the SMD it was decoded from, so
+ * the file doubles as a cache: a source with the same hash does not need to
+ * be decoded again.
+ */
+class EventCache
+{
+public:
+    static constexpr std::uint32_t version = 1;
+
+    struct Header
+    {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t channels;
+        std::uint64_t source_hash;
+        std::uint64_t source_size;
+        std::uint32_t events;
+        std::uint32_t tempo_count;
+        std::uint32_t instrument_count;
+        std::uint32_t reserved;
+    };
+
+    /* Events of a channel are [first_event, first_event + event_count) */
+    struct Channel
+    {
+        std::uint32_t first_event;
+        std::uint32_t event_count;
+        std::uint32_t length;
+        std::uint32_t reserved;
+    };
+
+    /* One 0xA0 "Set tempo" or 0xAC "Set instrument" event, value being its parameter */
+    struct TableEntry
+    {
+        std::uint32_t channel;
+        std::uint32_t event;
+        std::uint32_t tick;
+        std::uint32_t value;
+    };
+
+private:
+    MappedFile                                    file;
+    const Header                                 *header = nullptr;
+    std::span<const Channel>                      index;
+    std::span<const std::uint32_t>                ticks;
+    std::span<const unsigned char>                opcodes;
+    std::span<const unsigned char>                numParameters;
+    std::span<const std::array<unsigned char, 3>> parameters;
+    std::span<const TableEntry>                   tempos;
+    std::span<const TableEntry>                   instruments;
+
+    bool ContentsValid() const;
+
+public:
+    /*
+     * Returns false, leaving the object empty, unless the file is a complete
+     * cache of this version whose contents are safe to hand to consumers.
+     */
+    bool Open( const std::string &filename );
+    void Close();
+
+    /* Writes the file next to its final name and renames it, so readers never see half a cache */
+    static bool Write( const std::string &filename,
+                       const EventStream &events,
+                       std::uint64_t      source_hash,
+                       std::uint64_t      source_size );
+
+    inline bool Matches( std::uint64_t source_hash, std::uint64_t source_size ) const
+    {
+        return this->header != nullptr and this->header->source_hash == source_hash and
+               this->header->source_size == source_size;
+    }
+
+    inline std::span<const Channel> Channels() const
+    {
+        return this->index;
+    }
+
+    inline std::span<const std::uint32_t> Ticks() const
+    {
+        return this->ticks;
+    }
+
+    inline std::span<const unsigned char> Opcodes() const
+    {
+        return this->opcodes;
+    }
+
+    inline std::span<const unsigned char> NumParameters() const
+    {
+        return this->numParameters;
+    }
+
+    inline std::span<const std::array<unsigned char, 3>> Parameters() const
+    {
+        return this->parameters;
+    }
+
+    inline std::span<const TableEntry> Tempos() const
+    {
+        return this->tempos;
+    }
+
+    inline std::span<const TableEntry> Instruments() const
+    {
+        return this->instruments;
+    }
+
+    /* Copies the events back into a stream, for consumers that take an EventStream */
+    void ToEventStream( EventStream &events ) const;
+};
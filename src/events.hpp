@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Decoded song, stored as parallel arrays indexed by event. The events of
+ * a channel are contiguous and in decoding order, channels follow each
+ * other in header order. Ticks are absolute from the start of the channel,
+ * with loops left unexpanded.
+ */
+struct EventStream
+{
+    std::vector<unsigned char>                opcode;
+    std::vector<unsigned char>                num_parameters;
+    std::vector<std::array<unsigned char, 3>> parameters;
+    std::vector<unsigned char>                channel;
+    std::vector<unsigned int>                 tick;
+
+    /* Events of channel n are [channel_begin[n], channel_begin[n + 1]) */
+    std::vector<std::size_t>  channel_begin = { 0 };
+    /* Tick at which the last event of each channel ends */
+    std::vector<unsigned int> channel_length;
+
+    inline std::size_t Size() const
+    {
+        return this->opcode.size();
+    }
+
+    inline std::size_t Channels() const
+    {
+        return this->channel_length.size();
+    }
+
+    /* Keeps the capacity, so a stream can be refilled without allocating */
+    inline void Clear()
+    {
+        this->opcode.clear();
+        this->num_parameters.clear();
+        this->parameters.clear();
+        this->channel.clear();
+        this->tick.clear();
+        this->channel_begin.assign( 1, 0 );
+        this->channel_length.clear();
+    }
+
+    inline void Reserve( std::size_t events, std::size_t channels )
+    {
+        this->opcode.reserve( events );
+        this->num_parameters.reserve( events );
+        this->parameters.reserve( events );
+        this->channel.reserve( events );
+        this->tick.reserve( events );
+        this->channel_begin.reserve( channels + 1 );
+        this->channel_length.reserve( channels );
+    }
+
+    inline void Push( unsigned char                       code,
+                      unsigned char                       count,
+                      const std::array<unsigned char, 3> &values,
+                      unsigned char                       channel_index,
+                      unsigned int                        at )
+    {
+        this->opcode.push_back( code );
+        this->num_parameters.push_back( count );
+        this->parameters.push_back( values );
+        this->channel.push_back( channel_index );
+        this->tick.push_back( at );
+    }
+
+    /* Closes the channel whose events were pushed since the previous call */
+    inline void EndChannel( unsigned int length )
+    {
+        this->channel_begin.push_back( this->Size() );
+        this->channel_length.push_back( length );
+    }
+
+    /* Appends every channel of another stream after the channels of this one */
+    inline void Append( const EventStream &other )
+    {
+        this->opcode.insert( this->opcode.end(), other.opcode.begin(), other.opcode.end() );
+        this->num_parameters.insert( this->num_parameters.end(), other.num_parameters.begin(),
+                                     other.num_parameters.end() );
+        this->parameters.insert( this->parameters.end(), other.parameters.begin(), other.parameters.end() );
+        this->channel.insert( this->channel.end(), other.channel.begin(), other.channel.end() );
+        this->tick.insert( this->tick.end(), other.tick.begin(), other.tick.end() );
+
+        std::size_t base = this->channel_begin.back();
+        for ( std::size_t i = 1; i < other.channel_begin.size(); i++ )
+            this->channel_begin.push_back( base + other.channel_begin[i] );
+        this->channel_length.insert( this->channel_length.end(), other.channel_length.begin(),
+                                     other.channel_length.end() );
+    }
+};
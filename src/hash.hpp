@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+/* 64-bit FNV-1a. Songs are a few KB, so this is cheap next to a decode and good enough as a cache key */
+constexpr std::uint64_t ContentHash( std::span<const unsigned char> bytes )
+{
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+
+    for ( unsigned char byte : bytes )
+    {
+        hash ^= byte;
+        hash *= 0x00000100000001B3ull;
+    }
+
+    return hash;
+}
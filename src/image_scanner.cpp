@@ -0,0 +1,130 @@
+#include "image_scanner.hpp"
+#include "smd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace
+{
+    /* Regions smaller than this are not worth a thread */
+    constexpr std::size_t minimumRegion = 1 << 20;
+
+    unsigned int WorkerCount( unsigned int threads, std::size_t tasks )
+    {
+        if ( threads == 0 )
+            threads = std::max( 1u, std::thread::hardware_concurrency() );
+        return std::min<std::size_t>( threads, std::max<std::size_t>( tasks, 1 ) );
+    }
+
+    bool Validate( std::span<const unsigned char> image, std::size_t offset, SMD::Header &header, EmbeddedSMD &found )
+    {
+        std::span<const unsigned char> candidate  = image.subspan( offset );
+        unsigned int                   headerSize = 0;
+
+        if ( SMD::ParseHeader( candidate, header, headerSize ) != SMD::Status::Ok )
+            return false;
+
+        if ( header.file_size > candidate.size() or header.file_size < headerSize or header.number_of_channels == 0 )
+            return false;
+
+        if ( not SMD::ChannelOffsetsValid( header, headerSize, header.file_size ) )
+            return false;
+
+        found = EmbeddedSMD{ offset, candidate.first( header.file_size ), header.filename, header.number_of_channels };
+        return true;
+    }
+
+    void ScanRegion( std::span<const unsigned char> image,
+                     std::size_t                    begin,
+                     std::size_t                    end,
+                     std::vector<EmbeddedSMD>      &found )
+    {
+        SMD::Header header;
+        EmbeddedSMD hit;
+
+        for ( std::size_t at = begin; at < end; at++ )
+        {
+            const void *s = std::memchr( image.data() + at, 's', end - at );
+            if ( s == nullptr )
+                return;
+
+            at = static_cast<const unsigned char *>( s ) - image.data();
+            if ( image.size() - at >= 4 and std::memcmp( image.data() + at, "smds", 4 ) == 0 and
+                 Validate( image, at, header, hit ) )
+                found.push_back( hit );
+        }
+    }
+} // namespace
+
+std::vector<EmbeddedSMD> ScanImage( std::span<const unsigned char> image, unsigned int threads )
+{
+    threads = WorkerCount( threads, image.size() / minimumRegion );
+
+    std::vector<std::vector<EmbeddedSMD>> found( threads );
+    std::vector<std::thread>              pool;
+    const std::size_t                     region = ( image.size() + threads - 1 ) / threads;
+
+    for ( unsigned int i = 1; i < threads; i++ )
+        pool.emplace_back( ScanRegion, image, std::min( image.size(), i * region ),
+                           std::min( image.size(), ( i + 1 ) * region ), std::ref( found[i] ) );
+
+    ScanRegion( image, 0, std::min( image.size(), region ), found[0] );
+
+    for ( auto &thread : pool )
+        thread.join();
+
+    for ( unsigned int i = 1; i < threads; i++ )
+        found[0].insert( found[0].end(), found[i].begin(), found[i].end() );
+
+    return std::move( found[0] );
+}
+
+std::vector<BatchResult> ConvertEmbedded( const std::vector<EmbeddedSMD> &found,
+                                          const std::string              &output_prefix,
+                                          unsigned int                    threads )
+{
+    std::vector<BatchResult> results( found.size() );
+    for ( std::size_t i = 0; i < found.size(); i++ )
+    {
+        char offset[32];
+        std::snprintf( offset, sizeof( offset ), "%zx", found[i].offset );
+
+        results[i].input  = std::string( found[i].filename ) + " at 0x" + offset;
+        results[i].output = output_prefix + offset + ".mid";
+    }
+
+    /* Songs are small and similar in size, so a shared counter balances well enough */
+    std::atomic<std::size_t> next = 0;
+
+    auto worker = [&]()
+    {
+        SMD smd;
+        for ( std::size_t i; ( i = next++ ) < found.size(); )
+        {
+            SMD::Status status = smd.Load( std::as_bytes( found[i].bytes ) );
+
+            if ( status == SMD::Status::Ok )
+                status = smd.ToMIDI( results[i].output );
+
+            results[i].ok = status == SMD::Status::Ok;
+            if ( not results[i].ok )
+                results[i].error = SMD::Describe( status );
+        }
+    };
+
+    threads = WorkerCount( threads, found.size() );
+
+    std::vector<std::thread> pool;
+    for ( unsigned int i = 1; i < threads; i++ )
+        pool.emplace_back( worker );
+
+    worker();
+
+    for ( auto &thread : pool )
+        thread.join();
+
+    return results;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "batch.hpp"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* An SMD found inside a larger buffer, such as a disc image. `bytes` and `filename` point into that buffer */
+struct EmbeddedSMD
+{
+    std::size_t                    offset;
+    std::span<const unsigned char> bytes;
+    std::string_view               filename;
+    unsigned int                   channels;
+};
+
+/*
+ * Finds every SMD in `image` by its "smds" identifier. A candidate is only
+ * kept when its header parses, the zero terminator follows the channel
+ * offsets, file_size fits in the image and every channel offset falls in
+ * its data chunk, so stray "smds" strings are not reported. The image is
+ * split into one region of start offsets per thread (0 = one per hardware
+ * thread); headers may run past the end of their region. Hits are returned
+ * in image order.
+ */
+std::vector<EmbeddedSMD> ScanImage( std::span<const unsigned char> image, unsigned int threads = 0 );
+
+/*
+ * Converts the SMDs found by ScanImage() to MIDI straight from the image,
+ * without copying them out. Each output is <output_prefix><offset>.mid,
+ * with the offset in hex.
+ */
+std::vector<BatchResult> ConvertEmbedded( const std::vector<EmbeddedSMD> &found,
+                                          const std::string              &output_prefix,
+                                          unsigned int                    threads = 0 );
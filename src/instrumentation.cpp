@@ -0,0 +1,157 @@
+#include "instrumentation.hpp"
+
+namespace
+{
+    constexpr std::array<const char *, statsStageCount> stageNames = { "open", "parse_header", "read_data", "decode",
+                                                                       "output" };
+
+    void WriteString( std::FILE *output, const std::string &text )
+    {
+        std::fputc( '"', output );
+        for ( char c : text )
+        {
+            if ( c == '"' or c == '\\' )
+                std::fputc( '\\', output );
+
+            if ( (unsigned char)c < 0x20 )
+                std::fprintf( output, "\\u%04x", (unsigned int)(unsigned char)c );
+            else
+                std::fputc( c, output );
+        }
+        std::fputc( '"', output );
+    }
+} // namespace
+
+bool WriteReports( std::FILE *output, std::span<const FileReport> reports )
+{
+    std::fputs( "{\"files\":[", output );
+
+    for ( std::size_t f = 0; f < reports.size(); f++ )
+    {
+        const FileReport &report = reports[f];
+
+        std::fputs( f == 0 ? "\n{\"input\":" : ",\n{\"input\":", output );
+        WriteString( output, report.input );
+        std::fprintf( output, ",\"bytes\":%zu,\"allocations\":%zu,\"stages_ns\":{", report.bytes, report.allocations );
+
+        for ( std::size_t s = 0; s < statsStageCount; s++ )
+            std::fprintf( output, "%s\"%s\":%llu", s == 0 ? "" : ",", stageNames[s],
+                          (unsigned long long)report.stage_ns[s] );
+
+        std::fputs( "},\"channel_decode_ns\":[", output );
+        for ( std::size_t c = 0; c < report.channel_ns.size(); c++ )
+            std::fprintf( output, "%s%llu", c == 0 ? "" : ",", (unsigned long long)report.channel_ns[c] );
+
+        /* Only the opcodes that occur, keyed by their hex value */
+        std::fputs( "],\"opcodes\":{", output );
+        bool first = true;
+        for ( unsigned int code = 0; code < 256; code++ )
+        {
+            if ( report.opcodes[code] == 0 )
+                continue;
+
+            std::fprintf( output, "%s\"0x%02x\":%llu", first ? "" : ",", code,
+                          (unsigned long long)report.opcodes[code] );
+            first = false;
+        }
+
+        std::fputs( "}}", output );
+    }
+
+    std::fputs( "\n]}\n", output );
+    return std::fflush( output ) == 0 and not std::ferror( output );
+}
+
+#if defined( SMD_ENABLE_STATS )
+
+namespace
+{
+    thread_local FileReport *current     = nullptr;
+    thread_local std::size_t allocations = 0;
+
+    std::uint64_t Elapsed( std::chrono::steady_clock::time_point start )
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start )
+            .count();
+    }
+} // namespace
+
+void CountAllocation()
+{
+    allocations++;
+}
+
+FileReport *CurrentReport()
+{
+    return current;
+}
+
+FileReport *PrepareChannels( std::size_t channels )
+{
+    if ( current != nullptr )
+    {
+        current->channel_ns.assign( channels, 0 );
+        current->channel_allocations.assign( channels, 0 );
+    }
+
+    return current;
+}
+
+void CountBytes( std::size_t bytes )
+{
+    if ( current != nullptr )
+        current->bytes += bytes;
+}
+
+void CountOpcodes( const EventStream &events )
+{
+    if ( current == nullptr )
+        return;
+
+    for ( unsigned char code : events.opcode )
+        current->opcodes[code]++;
+}
+
+ReportScope::ReportScope( FileReport &report ) : previous( current ), allocationsAtStart( allocations )
+{
+    current = &report;
+}
+
+ReportScope::~ReportScope()
+{
+    current->allocations += allocations - this->allocationsAtStart;
+    for ( std::size_t count : current->channel_allocations )
+        current->allocations += count;
+
+    current = this->previous;
+}
+
+StageTimer::StageTimer( StatsStage stage )
+    : report( current ), stage( stage ), start( std::chrono::steady_clock::now() )
+{
+}
+
+StageTimer::~StageTimer()
+{
+    if ( this->report != nullptr )
+        this->report->stage_ns[(std::size_t)this->stage] += Elapsed( this->start );
+}
+
+ChannelTimer::ChannelTimer( FileReport *report, std::size_t channel )
+    : report( report ), channel( channel ), allocationsAtStart( allocations ), start( std::chrono::steady_clock::now() )
+{
+}
+
+ChannelTimer::~ChannelTimer()
+{
+    if ( this->report == nullptr )
+        return;
+
+    this->report->channel_ns[this->channel] = Elapsed( this->start );
+
+    /* On the owning thread these are already counted by the ReportScope */
+    if ( current != this->report )
+        this->report->channel_allocations[this->channel] = allocations - this->allocationsAtStart;
+}
+
+#endif
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "events.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Optional profiling of the conversion pipeline. It is only compiled in
+ * with -DSMD_ENABLE_STATS; otherwise every hook below is an empty inline
+ * function or an empty object, and the hot paths compile to the same code
+ * as without them.
+ *
+ * Measurements go to the FileReport installed on the calling thread by a
+ * ReportScope. Code running without a scope is not measured.
+ */
+
+enum class StatsStage : unsigned char
+{
+    Open,
+    ParseHeader,
+    ReadData,
+    Decode,
+    Output
+};
+
+inline constexpr std::size_t statsStageCount = 5;
+
+struct FileReport
+{
+    std::string                                input;
+    std::size_t                                bytes       = 0;
+    std::size_t                                allocations = 0;
+    std::array<std::uint64_t, statsStageCount> stage_ns    = {};
+    std::vector<std::uint64_t>                 channel_ns;
+    /* Allocations of decode threads other than the one owning the report */
+    std::vector<std::size_t>                   channel_allocations;
+    std::array<std::uint64_t, 256>             opcodes = {};
+};
+
+/* Writes the reports as one JSON document. Returns false on a write error */
+bool WriteReports( std::FILE *output, std::span<const FileReport> reports );
+
+#if defined( SMD_ENABLE_STATS )
+
+inline constexpr bool statsEnabled = true;
+
+/* Called by the program's operator new, the library does not replace it */
+void CountAllocation();
+
+FileReport *CurrentReport();
+
+/* Sizes the per-channel slots of the current report and returns it, so decode threads can reach it */
+FileReport *PrepareChannels( std::size_t channels );
+
+void CountBytes( std::size_t bytes );
+
+/* Per-opcode counters, taken from the decoded events so the decoder itself is left alone */
+void CountOpcodes( const EventStream &events );
+
+class ReportScope
+{
+private:
+    FileReport *previous;
+    std::size_t allocationsAtStart;
+
+public:
+    explicit ReportScope( FileReport &report );
+    ~ReportScope();
+};
+
+class StageTimer
+{
+private:
+    FileReport                           *report;
+    StatsStage                            stage;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StageTimer( StatsStage stage );
+    ~StageTimer();
+};
+
+class ChannelTimer
+{
+private:
+    FileReport                           *report;
+    std::size_t                           channel;
+    std::size_t                           allocationsAtStart;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    ChannelTimer( FileReport *report, std::size_t channel );
+    ~ChannelTimer();
+};
+
+#else
+
+inline constexpr bool statsEnabled = false;
+
+inline void CountAllocation()
+{
+}
+
+inline FileReport *CurrentReport()
+{
+    return nullptr;
+}
+
+inline FileReport *PrepareChannels( std::size_t )
+{
+    return nullptr;
+}
+
+inline void CountBytes( std::size_t )
+{
+}
+
+inline void CountOpcodes( const EventStream & )
+{
+}
+
+class ReportScope
+{
+public:
+    explicit ReportScope( FileReport & )
+    {
+    }
+};
+
+class StageTimer
+{
+public:
+    explicit StageTimer( StatsStage )
+    {
+    }
+};
+
+class ChannelTimer
+{
+public:
+    ChannelTimer( FileReport *, std::size_t )
+    {
+    }
+};
+
+#endif
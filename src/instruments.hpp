@@ -0,0 +1,389 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+/* Sample names, indexed by the parameter of 0xAC "Set instrument" */
+inline constexpr std::array<std::string_view, 256> instrumentNames = {
+    /* 0x00 */ "Heavy Square Wave (F-4)",
+    /* 0x01 */ "Empty",
+    /* 0x02 */ "Telephone (A#-3)",
+    /* 0x03 */ "Fat Saw Wave-Asp (F-4)",
+    /* 0x04 */ "Heavy Square Wave (F-4)",
+    /* 0x05 */ "Fat Saw Wave-Asp (F-5)",
+    /* 0x06 */ "Heavy Square Wave (F-5)",
+    /* 0x07 */ "Tuba (C-3)",
+    /* 0x08 */ "Glockenspiel (A-3)",
+    /* 0x09 */ "Bright Beep (C-3)",
+    /* 0x0A */ "Seashore (C-2)",
+    /* 0x0B */ "Seashore (C-3)",
+    /* 0x0C */ "Seashore (C-4)",
+    /* 0x0D */ "Drum Hit + Seashore (C-3)",
+    /* 0x0E */ "Telephone 2 (C-5)",
+    /* 0x0F */ "Explosion (C-2)",
+    /* 0x10 */ "Cymbal (A-3)",
+    /* 0x11 */ "Telephone 2 (C-7)",
+    /* 0x12 */ "Tubular Bells (C-5)",
+    /* 0x13 */ "Slap Bass 2 (C-1)",
+    /* 0x14 */ "Slap Bass 2 (C-2)",
+    /* 0x15 */ "Slap Bass 2 (C-3)",
+    /* 0x16 */ "Slap Bass 2 (C-4)",
+    /* 0x17 */ "Slap Bass 2 (C-5)",
+    /* 0x18 */ "Trumpet (C-3)",
+    /* 0x19 */ "Trumpet (C-4)",
+    /* 0x1A */ "Pizzicato Strings (C-3)",
+    /* 0x1B */ "Vibraslap/Spinner (A#-3)",
+    /* 0x1C */ "Bassoon (C-3)",
+    /* 0x1D */ "Bassoon (C-4)",
+    /* 0x1E */ "Bassoon (C-5)",
+    /* 0x1F */ "Machine Gun (C-5)",
+    /* 0x20 */ "Synth Strings (C-2)",
+    /* 0x21 */ "Synth Strings (C-4)",
+    /* 0x22 */ "Synth Strings (C-4)",
+    /* 0x23 */ "Synth Strings (C-5)",
+    /* 0x24 */ "Synth Strings (C-6)",
+    /* 0x25 */ "Synth Strings (C-7)",
+    /* 0x26 */ "Fretless Bass (C-2)",
+    /* 0x27 */ "Fretless Bass (C-3)",
+    /* 0x28 */ "Fretless Bass (C-4)",
+    /* 0x29 */ "Fretless Bass (C-5)",
+    /* 0x2A */ "Fretless Bass (C-6)",
+    /* 0x2B */ "Tuba (C-1)",
+    /* 0x2C */ "Tuba (C-2)",
+    /* 0x2D */ "Empty",
+    /* 0x2E */ "Bassoon (C-4)",
+    /* 0x2F */ "Bassoon (C-5)",
+    /* 0x30 */ "Trombone (C-2)",
+    /* 0x31 */ "Trombone (C-3)",
+    /* 0x32 */ "Trombone (C-4)",
+    /* 0x33 */ "Synth Brass 1",
+    /* 0x34 */ "Synth Brass 1",
+    /* 0x35 */ "Synth Brass 1",
+    /* 0x36 */ "Empty",
+    /* 0x37 */ "Empty",
+    /* 0x38 */ "Empty",
+    /* 0x39 */ "Cymbal Hit (A-3)",
+    /* 0x3A */ "Cymbal Hit (B-3)",
+    /* 0x3B */ "Vibraphone (C-3)",
+    /* 0x3C */ "French Horns (C-2)",
+    /* 0x3D */ "French Horns (C-3)",
+    /* 0x3E */ "French Horns (C-4)",
+    /* 0x3F */ "French Horns (C-5)",
+    /* 0x40 */ "Timpani (C-3)",
+    /* 0x41 */ "Pizzicato (C-4)",
+    /* 0x42 */ "Timpani (C-2)",
+    /* 0x43 */ "Tubular Bells (C-5)",
+    /* 0x44 */ "Clarinet (C-3)",
+    /* 0x45 */ "Empty",
+    /* 0x46 */ "Clarinet (C-4)",
+    /* 0x47 */ "Clarinet (C-5)",
+    /* 0x48 */ "Brush (A-4)",
+    /* 0x49 */ "Cymbal (A-3)",
+    /* 0x4A */ "French Horns (C-3)",
+    /* 0x4B */ "French Horns (C-4)",
+    /* 0x4C */ "French Horns (C-5)",
+    /* 0x4D */ "French Horns (C-6)",
+    /* 0x4E */ "French Horns (C-7)",
+    /* 0x4F */ "Trombone (C-1)",
+    /* 0x50 */ "Trombone (C-2)",
+    /* 0x51 */ "Trombone (C-3)",
+    /* 0x52 */ "Trombone (C-4)",
+    /* 0x53 */ "Trombone (C-5)",
+    /* 0x54 */ "Synth Strings (C-2)",
+    /* 0x55 */ "Synth Strings (C-3)",
+    /* 0x56 */ "Synth Strings (C-4)",
+    /* 0x57 */ "Synth Strings (C-5)",
+    /* 0x58 */ "Synth Strings (C-6)",
+    /* 0x59 */ "Synth Strings (C-7)",
+    /* 0x5A */ "Synth Strings 1 (C-2)",
+    /* 0x5B */ "Synth Strings 1 (C-3)",
+    /* 0x5C */ "Synth Strings 1 (C-4)",
+    /* 0x5D */ "Synth Strings 1 (C-5)",
+    /* 0x5E */ "Synth Strings 1 (C-6)",
+    /* 0x5F */ "Synth Strings 2 (C-2)",
+    /* 0x60 */ "Synth Strings 2 (C-3)",
+    /* 0x61 */ "Synth Strings 2 (C-4)",
+    /* 0x62 */ "Synth Strings 2 (C-5)",
+    /* 0x63 */ "Snare Hit (E-2)",
+    /* 0x64 */ "Synth Strings 1 (C-5)",
+    /* 0x65 */ "Tubular Bells (C-6)",
+    /* 0x66 */ "Bass Drum Hit (F-2)",
+    /* 0x67 */ "Empty",
+    /* 0x68 */ "Empty",
+    /* 0x69 */ "High-Frequency Noise",
+    /* 0x6A */ "High-Pitched Strings",
+    /* 0x6B */ "Sub-Bass Horn",
+    /* 0x6C */ "Bass Horn",
+    /* 0x6D */ "Horn",
+    /* 0x6E */ "Treble Horn",
+    /* 0x6F */ "Above-Treble Horn",
+    /* 0x70 */ "Oscillating Static",
+    /* 0x71 */ "Percussive Hammer",
+    /* 0x72 */ "Sustained Oscillating Bass Noise",
+    /* 0x73 */ "Low Percussive Hammer",
+    /* 0x74 */ "High-Frequency Oscillating Voice",
+    /* 0x75 */ "Metal Percussive Strike",
+    /* 0x76 */ "Wide Signal",
+    /* 0x77 */ "Pitched-Up Wide Signal",
+    /* 0x78 */ "Sub-Bass Horn",
+    /* 0x79 */ "Bass Horn",
+    /* 0x7A */ "Horn",
+    /* 0x7B */ "Treble Horn",
+    /* 0x7C */ "Above-Treble Horn",
+    /* 0x7D */ "Bass Tone",
+    /* 0x7E */ "Pitched-Up Bass Tone",
+    /* 0x7F */ "Wide Sub-Bass Tone",
+    /* 0x80 */ "Wide Bass Tone",
+    /* 0x81 */ "Wide Tone",
+    /* 0x82 */ "Ambient High-Frequency Voice",
+    /* 0x83 */ "High-Pitched Bell",
+    /* 0x84 */ "Ambient Voice",
+    /* 0x85 */ "Error Tone",
+    /* 0x86 */ "High-Frequency Tone",
+    /* 0x87 */ "Loud High-Frequency Tone",
+    /* 0x88 */ "Ambient High-Frequency Oscillating Tone",
+    /* 0x89 */ "Pitched-Up Ambient High-Frequency Oscillating Tone",
+    /* 0x8A */ "Drum Roll",
+    /* 0x8B */ "Bright Ambient Voice",
+    /* 0x8C */ "Cymbal Crashing",
+    /* 0x8D */ "Tremolo Noise",
+    /* 0x8E */ "Deep Ambient Voice",
+    /* 0x8F */ "Sub-Bass String",
+    /* 0x90 */ "Bass String",
+    /* 0x91 */ "String",
+    /* 0x92 */ "Treble String",
+    /* 0x93 */ "Above-Treble String",
+    /* 0x94 */ "High-Pitched String",
+    /* 0x95 */ "Wide Sub-Bass String",
+    /* 0x96 */ "Wide Bass String",
+    /* 0x97 */ "Wide String",
+    /* 0x98 */ "Wide Treble String",
+    /* 0x99 */ "Wide Above-Treble String",
+    /* 0x9A */ "Wide High-Pitched String",
+    /* 0x9B */ "Bass Vibrato String",
+    /* 0x9C */ "Vibrato String",
+    /* 0x9D */ "Treble Vibrato String",
+    /* 0x9E */ "Above-Treble Vibrato String",
+    /* 0x9F */ "High-Pitched Vibrato String",
+    /* 0xA0 */ "Bass String (Duplicate of 161)",
+    /* 0xA1 */ "Bass String",
+    /* 0xA2 */ "Treble String",
+    /* 0xA3 */ "Above-Treble String",
+    /* 0xA4 */ "Bass String",
+    /* 0xA5 */ "String",
+    /* 0xA6 */ "Above-Treble String",
+    /* 0xA7 */ "Treble Bell (Envelope Close)",
+    /* 0xA8 */ "Above-Treble Voice",
+    /* 0xA9 */ "Bell (Envelope Close)",
+    /* 0xAA */ "Staccato Bell",
+    /* 0xAB */ "Bell (Envelope Close)",
+    /* 0xAC */ "Bass Muted Horn",
+    /* 0xAD */ "Muted Horn",
+    /* 0xAE */ "Treble Muted Horn",
+    /* 0xAF */ "Above-Treble Muted Horn",
+    /* 0xB0 */ "Static Clip  Hit/slap sound",
+    /* 0xB1 */ "Clipped Thump",
+    /* 0xB2 */ "Inaudible Clip",
+    /* 0xB3 */ "Nearly Inaudible Clip",
+    /* 0xB4 */ "Blip",
+    /* 0xB5 */ "Empty",
+    /* 0xB6 */ "Empty",
+    /* 0xB7 */ "Empty",
+    /* 0xB8 */ "Clip",
+    /* 0xB9 */ "Empty",
+    /* 0xBA */ "Empty",
+    /* 0xBB */ "Empty",
+    /* 0xBC */ "Empty",
+    /* 0xBD */ "Blip",
+    /* 0xBE */ "Nearly Inaudible Clip",
+    /* 0xBF */ "Empty",
+    /* 0xC0 */ "Empty",
+    /* 0xC1 */ "Empty",
+    /* 0xC2 */ "Empty",
+    /* 0xC3 */ "Nearly Inaudible Clip",
+    /* 0xC4 */ "Blip",
+    /* 0xC5 */ "Empty",
+    /* 0xC6 */ "Empty",
+    /* 0xC7 */ "Empty",
+    /* 0xC8 */ "Empty",
+    /* 0xC9 */ "Empty",
+    /* 0xCA */ "Empty",
+    /* 0xCB */ "Empty",
+    /* 0xCC */ "Empty",
+    /* 0xCD */ "Empty",
+    /* 0xCE */ "Empty",
+    /* 0xCF */ "Empty",
+    /* 0xD0 */ "Empty",
+    /* 0xD1 */ "Empty",
+    /* 0xD2 */ "Empty",
+    /* 0xD3 */ "Blip",
+    /* 0xD4 */ "Nearly Inaudible Clip",
+    /* 0xD5 */ "Empty",
+    /* 0xD6 */ "Pop",
+    /* 0xD7 */ "Empty",
+    /* 0xD8 */ "Pop",
+    /* 0xD9 */ "Pop",
+    /* 0xDA */ "Pop",
+    /* 0xDB */ "Empty",
+    /* 0xDC */ "Empty",
+    /* 0xDD */ "Empty",
+    /* 0xDE */ "Empty",
+    /* 0xDF */ "Empty",
+    /* 0xE0 */ "Empty",
+    /* 0xE1 */ "Empty",
+    /* 0xE2 */ "Empty",
+    /* 0xE3 */ "Empty",
+    /* 0xE4 */ "Empty",
+    /* 0xE5 */ "Empty",
+    /* 0xE6 */ "Empty",
+    /* 0xE7 */ "Empty",
+    /* 0xE8 */ "Empty",
+    /* 0xE9 */ "Empty",
+    /* 0xEA */ "Pop",
+    /* 0xEB */ "Empty",
+    /* 0xEC */ "Inaudible Clip",
+    /* 0xED */ "Bell",
+    /* 0xEE */ "Empty",
+    /* 0xEF */ "Pop",
+    /* 0xF0 */ "Static + Bass String",
+    /* 0xF1 */ "Empty",
+    /* 0xF2 */ "Empty",
+    /* 0xF3 */ "Bell (Envelope Close)",
+    /* 0xF4 */ "Nearly Inaudible Clip",
+    /* 0xF5 */ "Empty",
+    /* 0xF6 */ "Pop",
+    /* 0xF7 */ "Nearly Inaudible Clip",
+    /* 0xF8 */ "Nearly Inaudible Clip",
+    /* 0xF9 */ "Empty",
+    /* 0xFA */ "Empty",
+    /* 0xFB */ "Empty",
+    /* 0xFC */ "Empty",
+    /* 0xFD */ "Empty",
+    /* 0xFE */ "Empty",
+    /* 0xFF */ "Empty",
+};
+
+/*
+ * What the MIDI output needs to know about an instrument. Everything is
+ * derived from the name at compile time, so a program change is a single
+ * array index.
+ */
+struct InstrumentInfo
+{
+    std::string_view name;
+    /* General MIDI program, 0-127 */
+    unsigned char    program;
+    /* Semitones between the "(C-3)"-style root of the sample and C-4, 0 when the name has none */
+    signed char      transpose;
+    /* Percussion samples are played on MIDI channel 10 as drum_key */
+    bool             drum;
+    unsigned char    drum_key;
+};
+
+/* "Telephone (A#-3)" is A#3, ten semitones above C-3. Returns 0 without an annotation */
+constexpr signed char InstrumentTranspose( std::string_view name )
+{
+    /* Semitones above C of the notes A to G */
+    constexpr std::array<int, 7> semitones = { 9, 11, 0, 2, 4, 5, 7 };
+
+    std::size_t at = name.find( '(' );
+    if ( at == std::string_view::npos or at + 4 > name.size() or name[at + 1] < 'A' or name[at + 1] > 'G' )
+        return 0;
+
+    int note = semitones[name[at + 1] - 'A'];
+    at += 2;
+
+    if ( name[at] == '#' )
+    {
+        note++;
+        at++;
+    }
+
+    if ( at + 1 >= name.size() or name[at] != '-' or name[at + 1] < '0' or name[at + 1] > '9' )
+        return 0;
+
+    return (signed char)( 12 * ( name[at + 1] - '0' ) + note - 12 * 4 );
+}
+
+constexpr std::array<InstrumentInfo, 256> MakeInstrumentTable()
+{
+    struct Keyword
+    {
+        std::string_view word;
+        unsigned char    program;
+        bool             drum;
+        unsigned char    drum_key;
+    };
+
+    /* Checked in order, so more specific names come before the words they contain */
+    constexpr Keyword keywords[] = {
+        { "Bass Drum", 0, true, 36 },
+        { "Drum Hit", 0, true, 36 },
+        { "Drum Roll", 0, true, 38 },
+        { "Snare", 0, true, 38 },
+        { "Brush", 0, true, 40 },
+        { "Cymbal", 0, true, 49 },
+        { "Vibraslap", 0, true, 58 },
+        { "Square", 80, false, 0 },
+        { "Saw", 81, false, 0 },
+        { "Telephone", 124, false, 0 },
+        { "Glockenspiel", 9, false, 0 },
+        { "Vibraphone", 11, false, 0 },
+        { "Tubular Bells", 14, false, 0 },
+        { "Bell", 112, false, 0 },
+        { "Seashore", 122, false, 0 },
+        { "Explosion", 127, false, 0 },
+        { "Machine Gun", 127, false, 0 },
+        { "Slap Bass", 37, false, 0 },
+        { "Fretless Bass", 35, false, 0 },
+        { "Trumpet", 56, false, 0 },
+        { "Trombone", 57, false, 0 },
+        { "Tuba", 58, false, 0 },
+        { "Muted Horn", 59, false, 0 },
+        { "French Horns", 60, false, 0 },
+        { "Synth Brass", 62, false, 0 },
+        { "Horn", 61, false, 0 },
+        { "Bassoon", 70, false, 0 },
+        { "Clarinet", 71, false, 0 },
+        { "Timpani", 47, false, 0 },
+        { "Pizzicato", 45, false, 0 },
+        { "Synth Strings 2", 51, false, 0 },
+        { "Synth Strings", 50, false, 0 },
+        { "Vibrato String", 40, false, 0 },
+        { "String", 48, false, 0 },
+        { "Voice", 52, false, 0 },
+        { "Percussive", 115, false, 0 },
+        { "Noise", 121, false, 0 },
+        { "Static", 121, false, 0 },
+        { "Tone", 80, false, 0 },
+        { "Beep", 80, false, 0 },
+        { "Blip", 80, false, 0 },
+    };
+
+    std::array<InstrumentInfo, 256> table{};
+
+    for ( unsigned int i = 0; i < 256; i++ )
+    {
+        std::string_view name = instrumentNames[i];
+        table[i]              = InstrumentInfo{ name, 0, InstrumentTranspose( name ), false, 0 };
+
+        for ( const auto &keyword : keywords )
+        {
+            if ( name.find( keyword.word ) != std::string_view::npos )
+            {
+                table[i].program  = keyword.program;
+                table[i].drum     = keyword.drum;
+                table[i].drum_key = keyword.drum_key;
+                break;
+            }
+        }
+    }
+
+    return table;
+}
+
+inline constexpr std::array<InstrumentInfo, 256> instruments = MakeInstrumentTable();
+
+static_assert( instruments[0x00].transpose == 5 and instruments[0x02].transpose == -2 and
+               instruments[0x13].transpose == -36 );
+static_assert( instruments[0x66].drum and instruments[0x66].drum_key == 36 and not instruments[0x07].drum );
@@ -0,0 +1,443 @@
+#include "batch.hpp"
+#include "daemon.hpp"
+#include "disassembler.hpp"
+#include "image_scanner.hpp"
+#include "instrumentation.hpp"
+#include "mapped_file.hpp"
+#include "preview.hpp"
+#include "smd.hpp"
+#include "smd_index.hpp"
+#include "statistics.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined( SMD_ENABLE_STATS )
+/*
+ *=======================*
+ * ALLOCATION ACCOUNTING *
+ *=======================*
+ */
+void *operator new( std::size_t size )
+{
+    CountAllocation();
+    if ( void *p = std::malloc( size == 0 ? 1 : size ) )
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[]( std::size_t size )
+{
+    return ::operator new( size );
+}
+
+void operator delete( void *p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void *p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete[]( void *p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+#endif
+
+namespace
+{
+    void Usage( const char *program )
+    {
+        std::cerr << "Usage: " << program
+                  << " [--stats] [--format text|csv|json|quiet] [--repeats N] <file.smd> [output.mid]" << std::endl;
+        std::cerr << "       " << program
+                  << " --batch [--stats] [--cache] [--jobs N] [--output DIR] <directory|file.smd>..." << std::endl;
+        std::cerr << "       " << program << " --info <directory|file.smd>..." << std::endl;
+        std::cerr << "       " << program << " --summary <directory|file.smd>..." << std::endl;
+        std::cerr << "       " << program << " --scan [--jobs N] [--output DIR] <image>..." << std::endl;
+        std::cerr << "       " << program << " --daemon [--jobs N] [--cache MB] <socket>" << std::endl;
+        std::cerr << "       " << program << " --wav [--rate N] [--repeats N] [--jobs N] <file.smd> <output.wav>"
+                  << std::endl;
+    }
+
+    bool StatsAvailable()
+    {
+        if ( not statsEnabled )
+            std::cerr << "--stats needs a build with -DSMD_ENABLE_STATS" << std::endl;
+        return statsEnabled;
+    }
+
+    int RunScan( int argc, char **argv )
+    {
+        std::vector<std::string> images;
+        std::string              output_directory;
+        unsigned int             jobs = 0;
+
+        for ( int i = 2; i < argc; i++ )
+        {
+            if ( std::strcmp( argv[i], "--jobs" ) == 0 and i + 1 < argc )
+                jobs = std::strtoul( argv[++i], nullptr, 10 );
+            else if ( std::strcmp( argv[i], "--output" ) == 0 and i + 1 < argc )
+                output_directory = argv[++i];
+            else
+                images.push_back( argv[i] );
+        }
+
+        if ( images.empty() )
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+
+        if ( not output_directory.empty() )
+        {
+            std::error_code error;
+            std::filesystem::create_directories( output_directory, error );
+        }
+
+        MappedFile  image;
+        std::size_t failed = 0;
+
+        for ( const auto &input : images )
+        {
+            if ( not image.Open( input ) )
+            {
+                std::cout << input << ": " << SMD::Describe( SMD::Status::CannotMapFile ) << '\n';
+                failed++;
+                continue;
+            }
+
+            std::vector<EmbeddedSMD> found = ScanImage( image.Bytes(), jobs );
+            std::cout << input << ": " << found.size() << " SMD files\n";
+
+            for ( const auto &smd : found )
+                std::cout << "  0x" << std::hex << smd.offset << std::dec << ": " << smd.filename << ", "
+                          << smd.channels << " channels, " << smd.bytes.size() << " bytes\n";
+
+            if ( output_directory.empty() )
+                continue;
+
+            std::filesystem::path prefix = std::filesystem::path( output_directory ) /
+                                           std::filesystem::path( input ).filename();
+
+            for ( const auto &result : ConvertEmbedded( found, prefix.string() + "_", jobs ) )
+            {
+                if ( result.ok )
+                    std::cout << "OK     " << result.input << " -> " << result.output << '\n';
+                else
+                    std::cout << "FAILED " << result.input << ": " << result.error << '\n';
+
+                failed += not result.ok;
+            }
+        }
+
+        std::cout.flush();
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int RunDaemon( int argc, char **argv )
+    {
+        std::string  socket_path;
+        unsigned int jobs      = 0;
+        std::size_t  cache_mib = 64;
+
+        for ( int i = 2; i < argc; i++ )
+        {
+            if ( std::strcmp( argv[i], "--jobs" ) == 0 and i + 1 < argc )
+                jobs = std::strtoul( argv[++i], nullptr, 10 );
+            else if ( std::strcmp( argv[i], "--cache" ) == 0 and i + 1 < argc )
+                cache_mib = std::strtoul( argv[++i], nullptr, 10 );
+            else
+                socket_path = argv[i];
+        }
+
+        if ( socket_path.empty() )
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+
+        ConversionDaemon daemon( socket_path, jobs, cache_mib << 20 );
+        if ( not daemon.Run() )
+        {
+            std::cerr << "Could not listen on " << socket_path << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    int RunWav( int argc, char **argv )
+    {
+        std::vector<std::string> arguments;
+        PreviewOptions           options;
+
+        for ( int i = 2; i < argc; i++ )
+        {
+            if ( std::strcmp( argv[i], "--rate" ) == 0 and i + 1 < argc )
+                options.sample_rate = std::strtoul( argv[++i], nullptr, 10 );
+            else if ( std::strcmp( argv[i], "--repeats" ) == 0 and i + 1 < argc )
+                options.max_forever_repeats = std::strtoul( argv[++i], nullptr, 10 );
+            else if ( std::strcmp( argv[i], "--jobs" ) == 0 and i + 1 < argc )
+                options.threads = std::strtoul( argv[++i], nullptr, 10 );
+            else
+                arguments.push_back( argv[i] );
+        }
+
+        if ( arguments.size() != 2 or options.sample_rate == 0 )
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+
+        SMD         smd;
+        SMD::Status status = smd.Open( arguments[0] );
+        if ( status != SMD::Status::Ok )
+        {
+            std::cerr << SMD::Describe( status ) << ": " << arguments[0] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        status     = RenderPreview( smd, arguments[1], options );
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if ( status != SMD::Status::Ok )
+        {
+            std::cerr << SMD::Describe( status ) << ": " << arguments[1] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << arguments[0] << " -> " << arguments[1] << " in " << elapsed.count() << " s" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    int RunSummary( int argc, char **argv )
+    {
+        SMD           smd;
+        OpcodeScanner scanner;
+        std::size_t   failed = 0;
+
+        for ( const auto &input : CollectInputs( std::vector<std::string>( argv + 2, argv + argc ) ) )
+        {
+            SMD::Status status = smd.Open( input );
+            if ( status != SMD::Status::Ok )
+            {
+                std::cout << input << ": " << SMD::Describe( status ) << '\n';
+                failed++;
+                continue;
+            }
+
+            std::cout << input << ":\n";
+            PrintSummary( std::cout, scanner.Scan( smd ) );
+        }
+
+        std::cout.flush();
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int RunInfo( int argc, char **argv )
+    {
+        SMDIndex    index;
+        std::size_t failed = 0;
+
+        for ( const auto &input : CollectInputs( std::vector<std::string>( argv + 2, argv + argc ) ) )
+        {
+            SMD::Status status = index.Open( input );
+            if ( status != SMD::Status::Ok )
+            {
+                std::cout << input << ": " << SMD::Describe( status ) << '\n';
+                failed++;
+                continue;
+            }
+
+            const SMD::Header &header = index.GetHeader();
+            std::cout << input << ": " << header.filename << ", " << index.Channels() << " channels, "
+                      << header.file_size << " bytes\n";
+        }
+
+        std::cout.flush();
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int RunBatch( int argc, char **argv )
+    {
+        std::vector<std::string> paths;
+        std::string              output_directory;
+        unsigned int             jobs  = 0;
+        bool                     stats = false;
+        bool                     cache = false;
+
+        for ( int i = 2; i < argc; i++ )
+        {
+            if ( std::strcmp( argv[i], "--jobs" ) == 0 and i + 1 < argc )
+                jobs = std::strtoul( argv[++i], nullptr, 10 );
+            else if ( std::strcmp( argv[i], "--output" ) == 0 and i + 1 < argc )
+                output_directory = argv[++i];
+            else if ( std::strcmp( argv[i], "--stats" ) == 0 )
+                stats = true;
+            else if ( std::strcmp( argv[i], "--cache" ) == 0 )
+                cache = true;
+            else
+                paths.push_back( argv[i] );
+        }
+
+        if ( paths.empty() )
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+
+        if ( stats and not StatsAvailable() )
+            return EXIT_FAILURE;
+
+        std::vector<FileReport> reports;
+        std::vector<BatchResult> results =
+            ConvertBatch( CollectInputs( paths ), output_directory, jobs, cache, stats ? &reports : nullptr );
+        std::size_t failed = 0;
+
+        for ( const auto &result : results )
+        {
+            if ( result.cached )
+                std::cout << "CACHED " << result.input << " -> " << result.output << '\n';
+            else if ( result.ok )
+                std::cout << "OK     " << result.input << " -> " << result.output << '\n';
+            else
+                std::cout << "FAILED " << result.input << ": " << result.error << '\n';
+
+            failed += not result.ok;
+        }
+
+        std::cout << results.size() - failed << " converted, " << failed << " failed" << std::endl;
+
+        if ( stats and not WriteReports( stderr, reports ) )
+            return EXIT_FAILURE;
+
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+} // namespace
+
+int main( int argc, char **argv )
+{
+    if ( argc < 2 )
+    {
+        Usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    if ( std::strcmp( argv[1], "--batch" ) == 0 )
+        return RunBatch( argc, argv );
+
+    if ( std::strcmp( argv[1], "--info" ) == 0 )
+        return RunInfo( argc, argv );
+
+    if ( std::strcmp( argv[1], "--summary" ) == 0 )
+        return RunSummary( argc, argv );
+
+    if ( std::strcmp( argv[1], "--scan" ) == 0 )
+        return RunScan( argc, argv );
+
+    if ( std::strcmp( argv[1], "--daemon" ) == 0 )
+        return RunDaemon( argc, argv );
+
+    if ( std::strcmp( argv[1], "--wav" ) == 0 )
+        return RunWav( argc, argv );
+
+    Disassembler::Format     format = Disassembler::Format::Text;
+    std::vector<std::string> arguments;
+    bool                     stats   = false;
+    unsigned int             repeats = 0;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( std::strcmp( argv[i], "--stats" ) == 0 )
+            stats = true;
+        else if ( std::strcmp( argv[i], "--repeats" ) == 0 and i + 1 < argc )
+            repeats = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--format" ) == 0 and i + 1 < argc )
+        {
+            if ( not Disassembler::ParseFormat( argv[++i], format ) )
+            {
+                Usage( argv[0] );
+                return EXIT_FAILURE;
+            }
+        }
+        else
+            arguments.push_back( argv[i] );
+    }
+
+    if ( arguments.empty() )
+    {
+        Usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    if ( stats and not StatsAvailable() )
+        return EXIT_FAILURE;
+
+    FileReport                 report;
+    std::optional<ReportScope> scope;
+    if ( stats )
+    {
+        report.input = arguments[0];
+        scope.emplace( report );
+    }
+
+    SMD         smd;
+    SMD::Status status = smd.Open( arguments[0] );
+
+    if ( status != SMD::Status::Ok )
+    {
+        std::cerr << SMD::Describe( status ) << ": " << arguments[0] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    /* ToMIDI plays the channels itself, the decoded stream is only needed for disassembly and the opcode counts */
+    const bool         midi   = arguments.size() > 1;
+    const EventStream *events = nullptr;
+    if ( not midi or stats )
+    {
+        events = &smd.Decode();
+        CountOpcodes( *events );
+    }
+
+    bool ok;
+    if ( midi )
+    {
+        smd.PrintHeader();
+        status = smd.ToMIDI( arguments[1], repeats );
+        ok     = status == SMD::Status::Ok;
+        if ( not ok )
+            std::cerr << SMD::Describe( status ) << ": " << arguments[1] << std::endl;
+    }
+    else
+    {
+        if ( format == Disassembler::Format::Text )
+            smd.PrintHeader();
+
+        StageTimer   timer( StatsStage::Output );
+        Disassembler disassembler( stdout, format, 1 << 20 );
+        disassembler.Write( *events );
+        ok = disassembler.Flush();
+    }
+
+    scope.reset();
+    if ( stats and not WriteReports( stderr, std::span( &report, 1 ) ) )
+        return EXIT_FAILURE;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,70 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+MappedFile::MappedFile( MappedFile &&other ) noexcept
+    : address( std::exchange( other.address, nullptr ) ), size( std::exchange( other.size, 0 ) )
+{
+}
+
+MappedFile &MappedFile::operator=( MappedFile &&other ) noexcept
+{
+    if ( this != &other )
+    {
+        this->Close();
+        this->address = std::exchange( other.address, nullptr );
+        this->size    = std::exchange( other.size, 0 );
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    this->Close();
+}
+
+bool MappedFile::Open( const std::string &filename )
+{
+    this->Close();
+
+    int fd = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        return false;
+
+    struct stat st;
+    if ( ::fstat( fd, &st ) != 0 or not S_ISREG( st.st_mode ) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    /* mmap() refuses empty mappings, an empty file is simply an empty span */
+    if ( st.st_size > 0 )
+    {
+        void *mapping = ::mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( mapping == MAP_FAILED )
+        {
+            ::close( fd );
+            return false;
+        }
+
+        ::madvise( mapping, st.st_size, MADV_SEQUENTIAL );
+        this->address = mapping;
+        this->size    = st.st_size;
+    }
+
+    ::close( fd );
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if ( this->address != nullptr )
+        ::munmap( this->address, this->size );
+
+    this->address = nullptr;
+    this->size    = 0;
+}
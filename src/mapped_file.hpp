@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+/*
+ * Read-only memory mapping of a whole file. The mapping lives as long as the
+ * object does, so spans handed out by Bytes() must not outlive it.
+ */
+class MappedFile
+{
+private:
+    void       *address = nullptr;
+    std::size_t size    = 0;
+
+public:
+    MappedFile() = default;
+    MappedFile( const MappedFile & )            = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+    MappedFile( MappedFile &&other ) noexcept;
+    MappedFile &operator=( MappedFile &&other ) noexcept;
+    ~MappedFile();
+
+    bool Open( const std::string &filename );
+    void Close();
+
+    inline std::span<const unsigned char> Bytes() const
+    {
+        return { static_cast<const unsigned char *>( this->address ), this->size };
+    }
+};
@@ -0,0 +1,279 @@
+#include "midi_writer.hpp"
+#include "instruments.hpp"
+#include "opcodes.hpp"
+#include "smd.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace
+{
+    void WriteBE32( unsigned char *out, unsigned int value )
+    {
+        out[0] = value >> 24;
+        out[1] = value >> 16;
+        out[2] = value >> 8;
+        out[3] = value;
+    }
+} // namespace
+
+void MidiTrack::Reset( unsigned char channel, std::size_t reserve )
+{
+    this->buffer.clear();
+    this->buffer.reserve( reserve );
+    this->tempo.clear();
+    this->sounding.reset();
+    this->pendingDelta = 0;
+    this->melodic      = channel % 15 < drums ? channel % 15 : channel % 15 + 1;
+    this->channel      = this->melodic;
+    this->drumKey.reset();
+    this->octave       = 4;
+    this->finished     = false;
+}
+
+void MidiTrack::WriteVLQ( unsigned int value )
+{
+    unsigned char bytes[5];
+    int           count = 0;
+
+    do
+    {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    } while ( value != 0 );
+
+    while ( count-- > 0 )
+        this->buffer.push_back( bytes[count] | ( count > 0 ? 0x80 : 0x00 ) );
+}
+
+void MidiTrack::WriteDelta()
+{
+    this->WriteVLQ( this->pendingDelta );
+    this->pendingDelta = 0;
+}
+
+void MidiTrack::Release()
+{
+    if ( not this->sounding.has_value() )
+        return;
+
+    this->WriteDelta();
+    this->buffer.insert( this->buffer.end(), { (unsigned char)( 0x80 | this->channel ), this->sounding.value(), 0x40 } );
+    this->sounding.reset();
+}
+
+/* The sounding note is released first, so its note-off goes to the channel that played it */
+void MidiTrack::Route( unsigned char to )
+{
+    if ( to == this->channel )
+        return;
+
+    this->Release();
+    this->channel = to;
+}
+
+void MidiTrack::Append( const Instruction &instruction )
+{
+    if ( this->finished )
+        return;
+
+    const unsigned char                 code       = instruction.code;
+    const std::array<unsigned char, 3> &parameters = instruction.parameters;
+    const Opcode                       &opcode     = opcodes[code];
+
+    if ( instruction.num_parameters < opcode.num_parameters )
+        return;
+
+    switch ( opcode.kind )
+    {
+    case OpcodeKind::Note:
+    {
+        unsigned int length = Duration( code, instruction.num_parameters, parameters );
+        int          key    = std::clamp( 12 * ( this->octave + 1 ) + parameters[0] / 0x13, 0, 127 );
+
+        if ( this->drumKey.has_value() )
+            key = this->drumKey.value();
+
+        this->Release();
+        this->WriteDelta();
+        this->buffer.insert( this->buffer.end(), { (unsigned char)( 0x90 | this->channel ), (unsigned char)key,
+                                                   std::max<unsigned char>( code, 1 ) } );
+        this->sounding = key;
+        this->pendingDelta += length;
+        break;
+    }
+    case OpcodeKind::Rest:
+        this->Release();
+        this->pendingDelta += parameters[0];
+        break;
+    case OpcodeKind::Extend:
+        this->pendingDelta += parameters[0];
+        break;
+    case OpcodeKind::SetOctave:
+        this->octave = parameters[0];
+        break;
+    case OpcodeKind::IncrementOctave:
+        this->octave++;
+        break;
+    case OpcodeKind::DecrementOctave:
+        this->octave--;
+        break;
+    case OpcodeKind::Instrument:
+    {
+        const InstrumentInfo &instrument = instruments[parameters[0]];
+
+        if ( instrument.drum )
+        {
+            this->Route( drums );
+            this->drumKey = instrument.drum_key;
+            break;
+        }
+
+        this->Route( this->melodic );
+        this->drumKey.reset();
+        this->WriteDelta();
+        this->buffer.insert( this->buffer.end(), { (unsigned char)( 0xC0 | this->channel ), instrument.program } );
+        break;
+    }
+    case OpcodeKind::EndChannel:
+        this->Finish();
+        break;
+    default:
+        break;
+    }
+}
+
+void MidiTrack::Tempo( unsigned int tick, unsigned char bpm )
+{
+    if ( bpm > 0 )
+        this->tempo.push_back( TempoChange{ tick, (unsigned int)this->tempo.size(), bpm } );
+}
+
+void MidiTrack::Finish()
+{
+    if ( this->finished )
+        return;
+
+    this->Release();
+
+    /*
+     * Channels are walked one after the other, so their tempo changes are
+     * merged here, in the same order as Timeline. Ties keep the order they
+     * were collected in, without the buffer std::stable_sort would allocate.
+     */
+    std::sort( this->tempo.begin(), this->tempo.end(), []( const TempoChange &a, const TempoChange &b )
+               { return a.tick < b.tick or ( a.tick == b.tick and a.order < b.order ); } );
+
+    unsigned int tick = 0;
+    for ( const TempoChange &change : this->tempo )
+    {
+        /* The meta event holds 24 bits, which the slowest tempos would overflow */
+        unsigned int microseconds = std::min( 60000000u / change.bpm, 0xFFFFFFu );
+
+        this->pendingDelta += change.tick - tick;
+        tick = change.tick;
+
+        this->WriteDelta();
+        this->buffer.insert( this->buffer.end(), { 0xFF, 0x51, 0x03, (unsigned char)( microseconds >> 16 ),
+                                                   (unsigned char)( microseconds >> 8 ), (unsigned char)microseconds } );
+    }
+
+    this->WriteDelta();
+    this->buffer.insert( this->buffer.end(), { 0xFF, 0x2F, 0x00 } );
+    this->finished = true;
+}
+
+bool BuildTracks( const SMD &smd, std::vector<MidiTrack> &tracks, unsigned int max_forever_repeats )
+{
+    bool complete = true;
+
+    const std::size_t channels = smd.Channels().size();
+    if ( tracks.size() < channels + 1 )
+        tracks.resize( channels + 1 );
+
+    MidiTrack &conductor = tracks[0];
+    conductor.Reset( 0, 64 );
+
+    for ( std::size_t c = 0; c < channels; c++ )
+    {
+        MidiTrack &track = tracks[c + 1];
+        track.Reset( c, 32 + 4 * smd.Channels()[c].size() );
+
+        LoopSequencer sequencer = smd.Sequence( c, max_forever_repeats );
+        while ( auto step = sequencer.Next() )
+        {
+            const Instruction &instruction = step->instruction;
+            if ( opcodes[instruction.code].kind == OpcodeKind::Tempo and instruction.num_parameters > 0 )
+                conductor.Tempo( step->tick, instruction.parameters[0] );
+
+            track.Append( instruction );
+        }
+
+        track.Finish();
+        complete = complete and not sequencer.Truncated();
+    }
+
+    conductor.Finish();
+    return complete;
+}
+
+bool WriteMidiFile( const std::string &filename, std::span<const MidiTrack> tracks )
+{
+    unsigned char header[14] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1 };
+    header[10] = tracks.size() >> 8;
+    header[11] = tracks.size();
+    header[12] = MidiTrack::division >> 8;
+    header[13] = MidiTrack::division & 0xFF;
+
+    std::vector<std::array<unsigned char, 8>> chunkHeaders( tracks.size() );
+    std::vector<iovec>                        iov;
+    iov.reserve( 1 + 2 * tracks.size() );
+    iov.push_back( { header, sizeof( header ) } );
+
+    for ( std::size_t i = 0; i < tracks.size(); i++ )
+    {
+        auto bytes = tracks[i].Bytes();
+
+        chunkHeaders[i] = { 'M', 'T', 'r', 'k' };
+        WriteBE32( chunkHeaders[i].data() + 4, bytes.size() );
+
+        iov.push_back( { chunkHeaders[i].data(), chunkHeaders[i].size() } );
+        iov.push_back( { const_cast<unsigned char *>( bytes.data() ), bytes.size() } );
+    }
+
+    int fd = ::open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+        return false;
+
+    /* writev() may stop short, in which case the remaining vectors are resubmitted */
+    std::size_t first = 0;
+    while ( first < iov.size() )
+    {
+        int     count   = std::min<std::size_t>( iov.size() - first, IOV_MAX );
+        ssize_t written = ::writev( fd, iov.data() + first, count );
+
+        if ( written < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            ::close( fd );
+            return false;
+        }
+
+        while ( first < iov.size() and (std::size_t)written >= iov[first].iov_len )
+            written -= iov[first++].iov_len;
+
+        if ( first < iov.size() )
+        {
+            iov[first].iov_base = static_cast<unsigned char *>( iov[first].iov_base ) + written;
+            iov[first].iov_len -= written;
+        }
+    }
+
+    return ::close( fd ) == 0;
+}
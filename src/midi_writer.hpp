@@ -0,0 +1,73 @@
+#pragma once
+
+#include "opcodes.hpp"
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+class SMD;
+
+/*
+ * Builds the body of one MTrk chunk from the instructions of one SMD
+ * channel, in playback order. Notes are monophonic within a channel: a note
+ * sounds until the next note or rest, and 0x81 only pushes its note-off
+ * further away.
+ * Tracks play on MIDI channel index % 15, skipping channel 10, which is
+ * where a track moves while a percussion instrument is selected. Tempo
+ * changes are left out, they belong to the conductor track.
+ */
+class MidiTrack
+{
+private:
+    struct TempoChange
+    {
+        unsigned int  tick;
+        unsigned int  order;
+        unsigned char bpm;
+    };
+
+    std::vector<unsigned char>   buffer;
+    std::vector<TempoChange>     tempo;
+    std::optional<unsigned char> sounding;
+    unsigned int                 pendingDelta = 0;
+    unsigned char                channel      = 0;
+    unsigned char                melodic      = 0;
+    std::optional<unsigned char> drumKey;
+    int                          octave       = 4;
+    bool                         finished     = false;
+
+    void WriteDelta();
+    void WriteVLQ( unsigned int value );
+    void Release();
+    void Route( unsigned char to );
+
+public:
+    static constexpr unsigned short division = 48;
+    static constexpr unsigned char  drums    = 9;
+
+    void Reset( unsigned char channel, std::size_t reserve );
+    void Append( const Instruction &instruction );
+    /* Conductor track only: tempo changes are collected in any order and written sorted by Finish() */
+    void Tempo( unsigned int tick, unsigned char bpm );
+    void Finish();
+
+    inline std::span<const unsigned char> Bytes() const
+    {
+        return this->buffer;
+    }
+};
+
+/*
+ * Fills tracks[0, smd.Channels().size() + 1): the conductor track, holding
+ * the tempo changes of every channel, then one track per channel, growing
+ * `tracks` when needed so that reused tracks keep their buffers. Channels
+ * are played through LoopSequencer, so 0x98/0x99 loops are written out as
+ * many times as they repeat and a 0x91 section is written once plus
+ * `max_forever_repeats` times, the same as Timeline and the WAV preview.
+ * Returns false when a channel was cut short at LoopSequencer's limits.
+ */
+bool BuildTracks( const SMD &smd, std::vector<MidiTrack> &tracks, unsigned int max_forever_repeats = 0 );
+
+/* Writes a type 1 Standard MIDI File with one MTrk per track in a single vectored write */
+bool WriteMidiFile( const std::string &filename, std::span<const MidiTrack> tracks );
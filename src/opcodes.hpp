@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+/*
+ * How the decoder has to treat an opcode. Everything that is not a note,
+ * an instrument change or an unknown byte is handled the same way, but the
+ * kinds are kept apart so consumers can tell the instructions apart without
+ * comparing raw byte values.
+ */
+enum class OpcodeKind : unsigned char
+{
+    Unknown,
+    Note,
+    Rest,
+    Extend,
+    EndChannel,
+    LoopForever,
+    SetOctave,
+    IncrementOctave,
+    DecrementOctave,
+    TimeSignature,
+    BeginLoop,
+    EndLoop,
+    Tempo,
+    Instrument,
+    BeginChannel,
+    AttackRate,
+    SustainRate,
+    Volume,
+    Balance,
+    PitchShift,
+    Generic
+};
+
+struct Opcode
+{
+    std::string_view message;
+    unsigned char    num_parameters;
+    OpcodeKind       kind;
+};
+
+constexpr std::array<Opcode, 256> MakeOpcodeTable()
+{
+    std::array<Opcode, 256> table{};
+
+    for ( unsigned int i = 0; i < 256; i++ )
+        table[i] = Opcode{ "Unknown opcode", 0, OpcodeKind::Unknown };
+
+    /* Notes take a parameter byte, plus a length byte when that parameter is a multiple of 0x13 */
+    for ( unsigned int i = 0x00; i <= 0x7F; i++ )
+        table[i] = Opcode{ "Play note ", 1, OpcodeKind::Note };
+
+    table[0x80] = Opcode{ "Rest for ", 1, OpcodeKind::Rest };
+    table[0x81] = Opcode{ "Extend previous note for ", 1, OpcodeKind::Extend };
+    table[0x90] = Opcode{ "End channel", 0, OpcodeKind::EndChannel };
+    table[0x91] = Opcode{ "Loop remainder of channel indefinitely", 0, OpcodeKind::LoopForever };
+    table[0x94] = Opcode{ "Set octave to ", 1, OpcodeKind::SetOctave };
+    table[0x95] = Opcode{ "Increment octave", 0, OpcodeKind::IncrementOctave };
+    table[0x96] = Opcode{ "Decrement octave", 0, OpcodeKind::DecrementOctave };
+    table[0x97] = Opcode{ "Set time signature to ", 2, OpcodeKind::TimeSignature };
+    table[0x98] = Opcode{ "Begin loop, times=", 1, OpcodeKind::BeginLoop };
+    table[0x99] = Opcode{ "End loop", 0, OpcodeKind::EndLoop };
+    table[0x9C] = Opcode{ "? ", 3, OpcodeKind::Generic };
+    table[0xA0] = Opcode{ "Set tempo to ", 1, OpcodeKind::Tempo };
+    table[0xAC] = Opcode{ "Set instrument to ", 1, OpcodeKind::Instrument };
+    table[0xBA] = Opcode{ "Begin channel", 0, OpcodeKind::BeginChannel };
+    table[0xBF] = Opcode{ "? ", 0, OpcodeKind::Generic };
+    table[0xC0] = Opcode{ "? ", 0, OpcodeKind::Generic };
+    table[0xC2] = Opcode{ "Set attack rate to ", 1, OpcodeKind::AttackRate };
+    table[0xC3] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xC4] = Opcode{ "Set sustain rate to ", 1, OpcodeKind::SustainRate };
+    table[0xC5] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xC6] = Opcode{ "Set sustain rate to ", 1, OpcodeKind::SustainRate };
+    table[0xC7] = Opcode{ "Set note volume? ", 2, OpcodeKind::Generic };
+    table[0xC8] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xC9] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xD2] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xD7] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xD8] = Opcode{ "Pitch shift ", 3, OpcodeKind::PitchShift };
+    table[0xDA] = Opcode{ "? ", 0, OpcodeKind::Generic };
+    table[0xDB] = Opcode{ "? ", 0, OpcodeKind::Generic };
+    table[0xE0] = Opcode{ "Set volume to ", 1, OpcodeKind::Volume };
+    table[0xE3] = Opcode{ "? ", 1, OpcodeKind::Generic };
+    table[0xE4] = Opcode{ "? ", 3, OpcodeKind::Generic };
+    table[0xE6] = Opcode{ "? ", 0, OpcodeKind::Generic };
+    table[0xE8] = Opcode{ "Set balance ", 1, OpcodeKind::Balance };
+
+    return table;
+}
+
+inline constexpr std::array<Opcode, 256> opcodes = MakeOpcodeTable();
+
+/* Size of every instruction that does not depend on its data. Notes are 0 */
+constexpr std::array<unsigned char, 256> MakeInstructionSizes()
+{
+    std::array<unsigned char, 256> sizes{};
+
+    for ( unsigned int i = 0; i < 256; i++ )
+        sizes[i] = opcodes[i].kind == OpcodeKind::Note ? 0 : 1 + opcodes[i].num_parameters;
+
+    return sizes;
+}
+
+inline constexpr std::array<unsigned char, 256> instructionSizes = MakeInstructionSizes();
+
+/* Note lengths in ticks, indexed by parameter % 0x13. Index 0 means the length is in the next byte */
+inline constexpr std::array<unsigned char, 0x13> noteLengths = { 0x00, 0xC0, 0x90, 0x60, 0x48, 0x40, 0x30,
+                                                                 0x24, 0x20, 0x18, 0x12, 0x10, 0x0C, 0x09,
+                                                                 0x08, 0x06, 0x04, 0x03, 0x02 };
+
+/* Number of ticks an instruction moves its channel forward by */
+constexpr unsigned int Duration( unsigned char                       code,
+                                 unsigned char                       num_parameters,
+                                 const std::array<unsigned char, 3> &parameters )
+{
+    if ( num_parameters == 0 )
+        return 0;
+
+    switch ( opcodes[code].kind )
+    {
+    case OpcodeKind::Note:
+    {
+        unsigned int length = noteLengths[parameters[0] % 0x13];
+        if ( length == 0 and num_parameters > 1 )
+            length = parameters[1];
+        return length;
+    }
+    case OpcodeKind::Rest:
+    case OpcodeKind::Extend:
+        return parameters[0];
+    default:
+        return 0;
+    }
+}
+
+struct Instruction
+{
+    unsigned char                code;
+    unsigned char                num_parameters;
+    std::array<unsigned char, 3> parameters;
+    unsigned int                 size;
+};
+
+/*
+ * Decodes the instruction starting at `offset`, which must be inside
+ * `bytes`. Parameters cut short by the end of `bytes` are left out, so
+ * num_parameters can be lower than the opcode's.
+ */
+inline Instruction ReadInstruction( std::span<const unsigned char> bytes, std::size_t offset )
+{
+    const unsigned char code   = bytes[offset];
+    const Opcode       &opcode = opcodes[code];
+    Instruction         instruction{ code, 0, {}, 1 };
+
+    std::size_t wanted = opcode.num_parameters;
+    for ( std::size_t at = offset + 1; instruction.num_parameters < wanted and at < bytes.size(); at++ )
+    {
+        instruction.parameters[instruction.num_parameters++] = bytes[at];
+
+        /* A note whose parameter is a multiple of 0x13 carries one more byte */
+        if ( opcode.kind == OpcodeKind::Note and instruction.num_parameters == 1 and bytes[at] % 0x13 == 0 )
+            wanted = 2;
+    }
+
+    instruction.size += instruction.num_parameters;
+    return instruction;
+}
+
+/* Same result as ReadInstruction(), for an instruction already known to fit in its buffer */
+inline Instruction ReadInstructionUnchecked( const unsigned char *bytes )
+{
+    const Opcode &opcode = opcodes[bytes[0]];
+    Instruction   instruction{ bytes[0], opcode.num_parameters, {}, 1u + opcode.num_parameters };
+
+    if ( opcode.kind == OpcodeKind::Note and bytes[1] % 0x13 == 0 )
+    {
+        instruction.num_parameters = 2;
+        instruction.size           = 3;
+    }
+
+    for ( unsigned int i = 0; i < instruction.num_parameters; i++ )
+        instruction.parameters[i] = bytes[1 + i];
+
+    return instruction;
+}
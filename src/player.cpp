@@ -0,0 +1,54 @@
+#include "player.hpp"
+#include "midi_writer.hpp"
+#include "smd.hpp"
+#include "timeline.hpp"
+
+EventPlayer::EventPlayer( const SMD &smd, unsigned int max_forever_repeats ) : bpm( Timeline::defaultBPM )
+{
+    this->voices.reserve( smd.Channels().size() );
+
+    for ( std::size_t c = 0; c < smd.Channels().size(); c++ )
+    {
+        Voice voice{ smd.Sequence( c, max_forever_repeats ), std::nullopt };
+        voice.pending = voice.sequencer.Next();
+        this->voices.push_back( voice );
+    }
+}
+
+std::optional<EventPlayer::TimedEvent> EventPlayer::Next()
+{
+    /* Lowest tick first, lowest channel on ties, so the order is deterministic */
+    Voice      *earliest = nullptr;
+    std::size_t channel  = 0;
+
+    for ( std::size_t c = 0; c < this->voices.size(); c++ )
+    {
+        Voice &voice = this->voices[c];
+        if ( voice.pending.has_value() and ( earliest == nullptr or voice.pending->tick < earliest->pending->tick ) )
+        {
+            earliest = &voice;
+            channel  = c;
+        }
+    }
+
+    if ( earliest == nullptr )
+        return std::nullopt;
+
+    const LoopSequencer::Step step = earliest->pending.value();
+    earliest->pending              = earliest->sequencer.Next();
+
+    /* Events come out in tick order, so the tempo map can be followed as it goes */
+    double seconds =
+        this->tempoSecond + ( step.tick - this->tempoTick ) * 60.0 / ( this->bpm * (double)MidiTrack::division );
+
+    const Instruction &instruction = step.instruction;
+    if ( opcodes[instruction.code].kind == OpcodeKind::Tempo and instruction.num_parameters > 0 and
+         instruction.parameters[0] > 0 )
+    {
+        this->bpm         = instruction.parameters[0];
+        this->tempoTick   = step.tick;
+        this->tempoSecond = seconds;
+    }
+
+    return TimedEvent{ channel, step.tick, seconds, instruction };
+}
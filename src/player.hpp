@@ -0,0 +1,50 @@
+#pragma once
+
+#include "sequencer.hpp"
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <vector>
+
+class SMD;
+
+/*
+ * Pull-based decoder for real-time playback. Each call to Next() decodes
+ * just enough to return the next event of the song in time order, across
+ * all channels, with its tick and wall-clock time. Between calls it only
+ * keeps one sequencer and one look-ahead instruction per channel, so the
+ * first event is available right away and 0x91 endless loops simply keep
+ * producing events. A 0x91 section that takes no time ends its channel
+ * after one pass, so it cannot hold the other channels back.
+ */
+class EventPlayer
+{
+public:
+    static constexpr unsigned int forever = std::numeric_limits<unsigned int>::max();
+
+    struct TimedEvent
+    {
+        std::size_t  channel;
+        unsigned int tick;
+        double       seconds;
+        Instruction  instruction;
+    };
+
+private:
+    struct Voice
+    {
+        LoopSequencer                      sequencer;
+        std::optional<LoopSequencer::Step> pending;
+    };
+
+    std::vector<Voice> voices;
+    unsigned int       bpm         = 0;
+    unsigned int       tempoTick   = 0;
+    double             tempoSecond = 0;
+
+public:
+    /* The SMD has to outlive the player */
+    explicit EventPlayer( const SMD &smd, unsigned int max_forever_repeats = forever );
+
+    std::optional<TimedEvent> Next();
+};
@@ -0,0 +1,528 @@
+#include "preview.hpp"
+#include "instruments.hpp"
+#include "opcodes.hpp"
+#include "timeline.hpp"
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <numbers>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    enum class Waveform
+    {
+        Sine,
+        Triangle,
+        Saw,
+        Square,
+        Noise
+    };
+
+    /* One waveform per General MIDI family of eight programs */
+    constexpr std::array<Waveform, 16> familyWaveforms = {
+        Waveform::Triangle, /* Piano */
+        Waveform::Sine,     /* Chromatic percussion */
+        Waveform::Square,   /* Organ */
+        Waveform::Saw,      /* Guitar */
+        Waveform::Triangle, /* Bass */
+        Waveform::Saw,      /* Strings */
+        Waveform::Saw,      /* Ensemble */
+        Waveform::Saw,      /* Brass */
+        Waveform::Square,   /* Reed */
+        Waveform::Sine,     /* Pipe */
+        Waveform::Square,   /* Synth lead */
+        Waveform::Saw,      /* Synth pad */
+        Waveform::Sine,     /* Synth effects */
+        Waveform::Saw,      /* Ethnic */
+        Waveform::Sine,     /* Percussive */
+        Waveform::Noise     /* Sound effects */
+    };
+
+    constexpr Waveform WaveformFor( const InstrumentInfo &instrument )
+    {
+        if ( instrument.drum )
+            return Waveform::Noise;
+
+        /* Lead 1 and 2 are the square and saw leads */
+        if ( instrument.program == 81 )
+            return Waveform::Saw;
+
+        return familyWaveforms[instrument.program / 8];
+    }
+
+    /* Every channel at full volume still leaves some headroom before clipping */
+    constexpr float channelGain = 0.25f;
+
+    /* Length of the fade at the end of every note, against clicks */
+    constexpr double releaseSeconds = 0.005;
+
+    /*
+     * Correction for the discontinuity of a naive saw or square at phase
+     * t, with dt the phase increment per sample. Removes most of the
+     * aliasing for two polynomials per edge.
+     */
+    inline float PolyBLEP( float t, float dt )
+    {
+        if ( t < dt )
+        {
+            t /= dt;
+            return t + t - t * t - 1.0f;
+        }
+
+        if ( t > 1.0f - dt )
+        {
+            t = ( t - 1.0f ) / dt;
+            return t * t + t + t + 1.0f;
+        }
+
+        return 0.0f;
+    }
+
+    struct Note
+    {
+        unsigned int           tick;
+        int                    key;
+        unsigned char          velocity;
+        Timeline::ChannelState state;
+    };
+
+    /*
+     * A note placed on the output, frames [first, first + frames), with the
+     * oscillator and envelope state needed to carry on rendering it in the
+     * next block.
+     */
+    struct Voice
+    {
+        Note          note;
+        std::size_t   first;
+        std::size_t   frames;
+        std::size_t   position = 0;
+        float         phase    = 0.0f;
+        float         level    = 1.0f;
+        std::uint32_t noise    = 0x9E3779B9u;
+    };
+
+    /* Fills `mono` with the next `count` samples of a voice, envelope included */
+    void RenderVoice( Voice &voice, unsigned int sample_rate, float *mono, std::size_t count )
+    {
+        const Note           &note       = voice.note;
+        const InstrumentInfo &instrument = instruments[note.state.instrument];
+        const Waveform        waveform   = WaveformFor( instrument );
+
+        const float frequency = 440.0f * std::exp2( ( note.key - 69 ) / 12.0f );
+        const float dt        = std::min( frequency / sample_rate, 0.5f );
+
+        /* The rates are mapped onto plausible times, the real curves are not known */
+        const std::size_t frames  = voice.frames;
+        const std::size_t attack  = note.state.attack * sample_rate / 512;
+        const float       decay   = instrument.drum ? 20.0f : note.state.sustain / 8.0f;
+        const float       falloff = std::exp( -decay / sample_rate );
+        const std::size_t release = std::min<std::size_t>( releaseSeconds * sample_rate, frames / 2 );
+
+        float         phase = voice.phase;
+        float         level = voice.level;
+        std::uint32_t noise = voice.noise;
+
+        for ( std::size_t i = voice.position, end = voice.position + count; i < end; i++ )
+        {
+            float sample;
+            switch ( waveform )
+            {
+            case Waveform::Sine:
+                sample = std::sin( 2.0f * std::numbers::pi_v<float> * phase );
+                break;
+            case Waveform::Triangle:
+                sample = 4.0f * std::fabs( phase - 0.5f ) - 1.0f;
+                break;
+            case Waveform::Saw:
+                sample = 2.0f * phase - 1.0f - PolyBLEP( phase, dt );
+                break;
+            case Waveform::Square:
+            {
+                float shifted = phase + 0.5f;
+                shifted -= shifted >= 1.0f ? 1.0f : 0.0f;
+                sample = ( phase < 0.5f ? 1.0f : -1.0f ) + PolyBLEP( phase, dt ) - PolyBLEP( shifted, dt );
+                break;
+            }
+            case Waveform::Noise:
+            default:
+                noise ^= noise << 13;
+                noise ^= noise >> 17;
+                noise ^= noise << 5;
+                sample = (float)(std::int32_t)noise / 2147483648.0f;
+                break;
+            }
+
+            phase += dt;
+            phase -= phase >= 1.0f ? 1.0f : 0.0f;
+
+            float envelope = level;
+            if ( i < attack )
+                envelope *= (float)i / attack;
+            if ( frames - i <= release )
+                envelope *= (float)( frames - i ) / release;
+
+            *mono++ = sample * envelope;
+            level *= falloff;
+        }
+
+        voice.phase = phase;
+        voice.level = level;
+        voice.noise = noise;
+        voice.position += count;
+    }
+
+    /*
+     *=============*
+     * SSE KERNELS *
+     *=============*
+     *------------------------------------------------------*
+     * Four samples at a time, then plain C++ for the tail *
+     *------------------------------------------------------*
+     */
+    void MixStereo( float *left, float *right, const float *mono, std::size_t frames, float leftGain, float rightGain )
+    {
+        std::size_t i = 0;
+
+#if defined( __SSE2__ )
+        const __m128 l = _mm_set1_ps( leftGain );
+        const __m128 r = _mm_set1_ps( rightGain );
+
+        for ( ; i + 4 <= frames; i += 4 )
+        {
+            __m128 sample = _mm_loadu_ps( mono + i );
+            _mm_storeu_ps( left + i, _mm_add_ps( _mm_loadu_ps( left + i ), _mm_mul_ps( sample, l ) ) );
+            _mm_storeu_ps( right + i, _mm_add_ps( _mm_loadu_ps( right + i ), _mm_mul_ps( sample, r ) ) );
+        }
+#endif
+
+        for ( ; i < frames; i++ )
+        {
+            left[i] += mono[i] * leftGain;
+            right[i] += mono[i] * rightGain;
+        }
+    }
+
+    void Accumulate( float *into, const float *from, std::size_t count )
+    {
+        std::size_t i = 0;
+
+#if defined( __SSE2__ )
+        for ( ; i + 4 <= count; i += 4 )
+            _mm_storeu_ps( into + i, _mm_add_ps( _mm_loadu_ps( into + i ), _mm_loadu_ps( from + i ) ) );
+#endif
+
+        for ( ; i < count; i++ )
+            into[i] += from[i];
+    }
+
+    /* Interleaves both channels into 16-bit samples, clipping at full scale */
+    void ToPCM16( const float *left, const float *right, std::size_t frames, std::int16_t *out )
+    {
+        std::size_t i = 0;
+
+#if defined( __SSE2__ )
+        const __m128 scale = _mm_set1_ps( 32767.0f );
+        const __m128 high  = _mm_set1_ps( 1.0f );
+        const __m128 low   = _mm_set1_ps( -1.0f );
+
+        for ( ; i + 4 <= frames; i += 4 )
+        {
+            __m128 l = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( left + i ), low ), high );
+            __m128 r = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( right + i ), low ), high );
+
+            __m128i first  = _mm_cvtps_epi32( _mm_mul_ps( _mm_unpacklo_ps( l, r ), scale ) );
+            __m128i second = _mm_cvtps_epi32( _mm_mul_ps( _mm_unpackhi_ps( l, r ), scale ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( out + 2 * i ), _mm_packs_epi32( first, second ) );
+        }
+#endif
+
+        for ( ; i < frames; i++ )
+        {
+            out[2 * i]     = (std::int16_t)std::lrint( std::clamp( left[i], -1.0f, 1.0f ) * 32767.0f );
+            out[2 * i + 1] = (std::int16_t)std::lrint( std::clamp( right[i], -1.0f, 1.0f ) * 32767.0f );
+        }
+    }
+
+    /*
+     * Plays one channel with its loops expanded and mixes it into the output
+     * one block at a time. As in the MIDI output, a note sounds until the
+     * next note or rest, so 0x81 simply lets it ring on. A note is only
+     * placed once the instruction that ends it is read, and at most one is
+     * kept between blocks.
+     */
+    class ChannelRenderer
+    {
+    private:
+        const Timeline        *timeline;
+        unsigned int           sampleRate;
+        std::size_t            totalFrames;
+        LoopSequencer          sequencer;
+        Timeline::ChannelState state;
+        std::optional<Note>    sounding;
+        std::optional<Voice>   voice;
+        unsigned int           end      = 0;
+        bool                   finished = false;
+
+        std::optional<Voice> Release( unsigned int tick )
+        {
+            if ( not this->sounding.has_value() )
+                return std::nullopt;
+
+            const Note note = this->sounding.value();
+            this->sounding.reset();
+
+            std::size_t first = this->timeline->Seconds( note.tick ) * this->sampleRate;
+            std::size_t last  = std::min<std::size_t>( this->timeline->Seconds( tick ) * this->sampleRate,
+                                                       this->totalFrames );
+            if ( first >= last )
+                return std::nullopt;
+
+            return Voice{ note, first, last - first };
+        }
+
+        std::optional<Voice> NextVoice()
+        {
+            while ( not this->finished )
+            {
+                auto step = this->sequencer.Next();
+                if ( not step.has_value() )
+                {
+                    this->finished = true;
+                    return this->Release( this->end );
+                }
+
+                const Instruction &instruction = step->instruction;
+                const Opcode      &opcode      = opcodes[instruction.code];
+
+                this->end = step->tick +
+                            Duration( instruction.code, instruction.num_parameters, instruction.parameters );
+
+                if ( instruction.num_parameters < opcode.num_parameters )
+                    continue;
+
+                std::optional<Voice> released;
+                switch ( opcode.kind )
+                {
+                case OpcodeKind::Note:
+                {
+                    unsigned char velocity = std::max<unsigned char>( instruction.code, 1 );
+                    int           key      = 12 * ( this->state.octave + 1 ) + instruction.parameters[0] / 0x13;
+
+                    released       = this->Release( step->tick );
+                    this->sounding = Note{ step->tick, std::clamp( key, 0, 127 ), velocity, this->state };
+                    break;
+                }
+                case OpcodeKind::Rest:
+                case OpcodeKind::EndChannel:
+                    released = this->Release( step->tick );
+                    break;
+                default:
+                    this->state.Apply( instruction );
+                    break;
+                }
+
+                if ( released.has_value() )
+                    return released;
+            }
+
+            return std::nullopt;
+        }
+
+    public:
+        ChannelRenderer( const SMD &smd, const Timeline &timeline, std::size_t channel, const PreviewOptions &options,
+                         std::size_t total_frames )
+            : timeline( &timeline ), sampleRate( options.sample_rate ), totalFrames( total_frames ),
+              sequencer( smd.Sequence( channel, options.max_forever_repeats ) )
+        {
+        }
+
+        /* Adds frames [begin, end) of the channel to the block, which starts at frame `begin` */
+        void Render( std::size_t begin, std::size_t end, float *left, float *right, std::vector<float> &scratch )
+        {
+            while ( true )
+            {
+                if ( not this->voice.has_value() )
+                {
+                    this->voice = this->NextVoice();
+                    if ( not this->voice.has_value() )
+                        return;
+                }
+
+                Voice &v = this->voice.value();
+                if ( v.first >= end )
+                    return;
+
+                const std::size_t from = v.first + v.position;
+                const std::size_t to   = std::min( v.first + v.frames, end );
+
+                const float gain = channelGain * ( v.note.velocity / 127.0f ) * ( v.note.state.volume / 127.0f );
+                const float pan  = std::min( v.note.state.balance, (unsigned char)0x7F ) / 127.0f;
+
+                scratch.resize( to - from );
+                RenderVoice( v, this->sampleRate, scratch.data(), scratch.size() );
+                MixStereo( left + ( from - begin ), right + ( from - begin ), scratch.data(), scratch.size(),
+                           gain * std::cos( pan * std::numbers::pi_v<float> / 2 ),
+                           gain * std::sin( pan * std::numbers::pi_v<float> / 2 ) );
+
+                if ( v.position < v.frames )
+                    return;
+
+                this->voice.reset();
+            }
+        }
+    };
+
+    void WriteLE16( unsigned char *out, unsigned int value )
+    {
+        out[0] = value;
+        out[1] = value >> 8;
+    }
+
+    void WriteLE32( unsigned char *out, unsigned int value )
+    {
+        out[0] = value;
+        out[1] = value >> 8;
+        out[2] = value >> 16;
+        out[3] = value >> 24;
+    }
+
+    /* 16-bit stereo */
+    constexpr std::size_t bytesPerFrame = 2 * sizeof( std::int16_t );
+
+    /* RIFF sizes are 32 bit and count the 36 header bytes after the size field, about 6.7 hours at 44.1 kHz */
+    constexpr std::size_t maxWAVFrames = ( 0xFFFFFFFFu - 36 ) / bytesPerFrame;
+
+    bool WriteWAVHeader( std::FILE *file, unsigned int sample_rate, std::size_t frames )
+    {
+        const std::uint32_t data = frames * bytesPerFrame;
+        unsigned char       header[44];
+
+        std::memcpy( header, "RIFF", 4 );
+        WriteLE32( header + 4, 36 + data );
+        std::memcpy( header + 8, "WAVEfmt ", 8 );
+        WriteLE32( header + 16, 16 );
+        WriteLE16( header + 20, 1 ); /* PCM */
+        WriteLE16( header + 22, 2 );
+        WriteLE32( header + 24, sample_rate );
+        WriteLE32( header + 28, sample_rate * bytesPerFrame );
+        WriteLE16( header + 32, bytesPerFrame );
+        WriteLE16( header + 34, 16 );
+        std::memcpy( header + 36, "data", 4 );
+        WriteLE32( header + 40, data );
+
+        return std::fwrite( header, 1, sizeof( header ), file ) == sizeof( header );
+    }
+
+    /* Frames rendered and written at a time, so memory does not grow with the length of the song */
+    constexpr std::size_t blockFrames = 1 << 15;
+} // namespace
+
+SMD::Status RenderPreview( const SMD &smd, const std::string &wav_file, const PreviewOptions &options )
+{
+    const Timeline    timeline( smd, 192, options.max_forever_repeats );
+    const std::size_t channels = smd.Channels().size();
+
+    if ( timeline.Truncated() )
+        return SMD::Status::ExpansionLimit;
+
+    unsigned int length = 0;
+    for ( std::size_t c = 0; c < channels; c++ )
+        length = std::max( length, timeline.Length( c ) );
+
+    const std::size_t frames = timeline.Seconds( length ) * options.sample_rate + 1;
+    const std::size_t blocks = ( frames + blockFrames - 1 ) / blockFrames;
+
+    /* Longer songs, easily reached with max_forever_repeats, would get a wrong header */
+    if ( frames > maxWAVFrames )
+        return SMD::Status::CannotWriteOutput;
+
+    std::FILE *file = std::fopen( wav_file.c_str(), "wb" );
+    if ( file == nullptr )
+        return SMD::Status::CannotWriteOutput;
+
+    bool written = WriteWAVHeader( file, options.sample_rate, frames );
+
+    /*
+     * Channels are dealt to the workers round robin. For every block, each
+     * worker mixes its channels into its own buffers, then the last worker
+     * to finish sums them in worker order, converts the block and writes it.
+     * The output then only depends on the number of workers, not on timing.
+     */
+    unsigned int workers = options.threads == 0 ? std::max( 1u, std::thread::hardware_concurrency() ) : options.threads;
+    workers              = std::max<std::size_t>( 1, std::min<std::size_t>( workers, channels ) );
+
+    std::vector<std::vector<float>> left( workers, std::vector<float>( blockFrames ) );
+    std::vector<std::vector<float>> right( workers, std::vector<float>( blockFrames ) );
+    std::vector<std::int16_t>       samples( 2 * blockFrames );
+    std::size_t                     block = 0;
+
+    auto mix = [&]() noexcept
+    {
+        const std::size_t begin = block * blockFrames;
+        const std::size_t count = std::min( blockFrames, frames - begin );
+
+        for ( unsigned int i = 1; i < workers; i++ )
+        {
+            Accumulate( left[0].data(), left[i].data(), count );
+            Accumulate( right[0].data(), right[i].data(), count );
+        }
+
+        /* Samples are written as they are in memory, which is little endian on every supported host */
+        ToPCM16( left[0].data(), right[0].data(), count, samples.data() );
+        written = written and std::fwrite( samples.data(), sizeof( std::int16_t ), 2 * count, file ) == 2 * count;
+        block++;
+    };
+
+    std::barrier done( workers, mix );
+
+    auto worker = [&]( unsigned int id )
+    {
+        std::vector<ChannelRenderer> renderers;
+        for ( std::size_t c = id; c < channels; c += workers )
+            renderers.emplace_back( smd, timeline, c, options, frames );
+
+        std::vector<float> scratch;
+
+        /* Every worker reads `block` and `written` after the same barrier, so they all stop together */
+        while ( written and block < blocks )
+        {
+            const std::size_t begin = block * blockFrames;
+            const std::size_t end   = std::min( begin + blockFrames, frames );
+
+            std::fill( left[id].begin(), left[id].end(), 0.0f );
+            std::fill( right[id].begin(), right[id].end(), 0.0f );
+
+            for ( auto &renderer : renderers )
+                renderer.Render( begin, end, left[id].data(), right[id].data(), scratch );
+
+            done.arrive_and_wait();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve( workers - 1 );
+    for ( unsigned int i = 1; i < workers; i++ )
+        pool.emplace_back( worker, i );
+
+    worker( 0 );
+
+    for ( auto &thread : pool )
+        thread.join();
+
+    if ( std::fclose( file ) != 0 or not written )
+        return SMD::Status::CannotWriteOutput;
+
+    return SMD::Status::Ok;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "smd.hpp"
+#include <string>
+
+struct PreviewOptions
+{
+    unsigned int sample_rate         = 44100;
+    /* How many extra times a 0x91 endless loop plays, as in LoopSequencer */
+    unsigned int max_forever_repeats = 0;
+    /* 0 = one per hardware thread */
+    unsigned int threads             = 0;
+};
+
+/*
+ * Renders a song to a 16-bit stereo WAV file through a small built-in
+ * synthesizer, so channels can be checked by ear without an external synth
+ * or SoundFont. Each instrument plays on a band-limited oscillator picked
+ * from its General MIDI family, shaped by the channel's attack and sustain
+ * rates, volume and balance. It is a preview, not an emulation of the
+ * console's sound chip. The file is rendered and written in short blocks,
+ * so memory stays flat however long the song and however many threads.
+ * Songs longer than a WAV file can hold, about 6.7 hours at 44.1 kHz, fail
+ * with CannotWriteOutput before anything is written, and songs whose loops
+ * reach LoopSequencer's limits fail with ExpansionLimit.
+ */
+SMD::Status RenderPreview( const SMD &smd, const std::string &wav_file, const PreviewOptions &options = {} );
@@ -0,0 +1,100 @@
+#include "sequencer.hpp"
+#include <algorithm>
+
+LoopSequencer::LoopSequencer( std::span<const unsigned char> bytes, unsigned int max_forever_repeats )
+    : bytes( bytes ), maxForeverRepeats( max_forever_repeats )
+{
+}
+
+bool LoopSequencer::Rewind()
+{
+    /*
+     * Reaching the end of a channel restarts its 0x91 section while repeats
+     * are left, unless the last pass did not move time forward: an empty or
+     * zero-length section would otherwise loop without ever yielding a tick.
+     */
+    if ( not this->state.foreverBegin.has_value() or this->state.foreverPasses >= this->maxForeverRepeats or
+         this->state.tick == this->state.foreverTick )
+        return false;
+
+    this->state.foreverPasses++;
+    this->state.foreverTick = this->state.tick;
+    this->state.offset = this->state.foreverBegin.value();
+    this->state.depth    = 0;
+    this->state.overflow = 0;
+    return true;
+}
+
+std::optional<LoopSequencer::Step> LoopSequencer::Next()
+{
+    State &s = this->state;
+
+    while ( not s.finished )
+    {
+        if ( s.offset >= this->bytes.size() )
+        {
+            if ( this->Rewind() )
+                continue;
+
+            s.finished = true;
+            break;
+        }
+
+        Step         step{ ReadInstruction( this->bytes, s.offset ), s.offset, s.tick };
+        unsigned int duration =
+            Duration( step.instruction.code, step.instruction.num_parameters, step.instruction.parameters );
+
+        /* Checked before moving, so the tick can never wrap around */
+        if ( s.steps >= maxSteps or duration > maxTicks - s.tick )
+        {
+            s.truncated = true;
+            s.finished  = true;
+            break;
+        }
+
+        s.offset += step.instruction.size;
+        s.tick += duration;
+        s.steps++;
+
+        switch ( opcodes[step.instruction.code].kind )
+        {
+        case OpcodeKind::BeginLoop:
+            /* Loops nested deeper than the stack are played once, only their nesting is counted */
+            if ( step.instruction.num_parameters == 0 )
+                break;
+            if ( s.depth < maxLoopDepth )
+                s.loops[s.depth++] = Loop{ s.offset, std::max<unsigned short>( step.instruction.parameters[0], 1 ) };
+            else
+                s.overflow++;
+            break;
+        case OpcodeKind::EndLoop:
+            if ( s.overflow > 0 )
+                s.overflow--;
+            else if ( s.depth > 0 )
+            {
+                Loop &loop = s.loops[s.depth - 1];
+                if ( --loop.remaining > 0 )
+                    s.offset = loop.begin;
+                else
+                    s.depth--;
+            }
+            break;
+        case OpcodeKind::LoopForever:
+            s.foreverBegin = s.offset;
+            s.foreverTick  = s.tick;
+            break;
+        case OpcodeKind::EndChannel:
+            if ( this->Rewind() )
+                continue;
+
+            s.finished = true;
+            break;
+        default:
+            break;
+        }
+
+        return step;
+    }
+
+    return std::nullopt;
+}
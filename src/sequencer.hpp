@@ -0,0 +1,140 @@
+#pragma once
+
+#include "opcodes.hpp"
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <span>
+
+/*
+ * Walks the bytes of one channel in playback order. Loops stay in their
+ * encoded form and are expanded on the fly: 0x98/0x99 loops through a
+ * bounded stack, and the 0x91 "loop remainder of channel" repeats at most
+ * `max_forever_repeats` times before the channel ends. A 0x91 section that
+ * takes no time is played once, since repeating it would never move the
+ * channel forward. Nothing is unrolled into memory, so the state is the
+ * same size however long the song plays.
+ * Nested loops can still multiply into more than anything could play, so a
+ * channel is cut short once it reaches maxSteps instructions or maxTicks
+ * ticks, and reports itself as truncated.
+ */
+class LoopSequencer
+{
+public:
+    static constexpr std::size_t  maxLoopDepth = 8;
+    /* About 48 hours at 120 BPM, well past anything the WAV preview can hold */
+    static constexpr unsigned int maxTicks     = 1u << 24;
+    static constexpr unsigned int maxSteps     = 1u << 22;
+
+    struct Step
+    {
+        Instruction  instruction;
+        unsigned int offset;
+        unsigned int tick;
+    };
+
+    struct Loop
+    {
+        unsigned int   begin;
+        unsigned short remaining;
+    };
+
+    /* Everything needed to resume playback from a given point */
+    struct State
+    {
+        unsigned int                   offset   = 0;
+        unsigned int                   tick     = 0;
+        std::array<Loop, maxLoopDepth> loops    = {};
+        unsigned char                  depth    = 0;
+        /* Open 0x98 past maxLoopDepth, whose 0x99 must not close an enclosing loop */
+        unsigned int                   overflow = 0;
+        std::optional<unsigned int>    foreverBegin;
+        /* Tick the current pass through the 0x91 section started at */
+        unsigned int                   foreverTick   = 0;
+        unsigned int                   foreverPasses = 0;
+        unsigned int                   steps         = 0;
+        bool                           finished      = false;
+        /* Ended at maxSteps or maxTicks rather than at the end of the channel */
+        bool                           truncated     = false;
+    };
+
+    class Iterator
+    {
+    private:
+        LoopSequencer      *sequencer = nullptr;
+        std::optional<Step> step;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = Step;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Step *;
+        using reference         = const Step &;
+
+        Iterator() = default;
+        explicit Iterator( LoopSequencer *sequencer ) : sequencer( sequencer ), step( sequencer->Next() )
+        {
+        }
+
+        inline reference operator*() const
+        {
+            return *this->step;
+        }
+
+        inline pointer operator->() const
+        {
+            return &*this->step;
+        }
+
+        inline Iterator &operator++()
+        {
+            this->step = this->sequencer->Next();
+            return *this;
+        }
+
+        inline bool operator==( const Iterator &other ) const
+        {
+            return this->step.has_value() == other.step.has_value();
+        }
+    };
+
+private:
+    std::span<const unsigned char> bytes;
+    State                          state;
+    unsigned int                   maxForeverRepeats = 0;
+
+    bool Rewind();
+
+public:
+    LoopSequencer() = default;
+    LoopSequencer( std::span<const unsigned char> bytes, unsigned int max_forever_repeats );
+
+    /* The next instruction in playback order, or nothing once the channel has ended */
+    std::optional<Step> Next();
+
+    inline const State &GetState() const
+    {
+        return this->state;
+    }
+
+    inline bool Truncated() const
+    {
+        return this->state.truncated;
+    }
+
+    inline void Restore( const State &saved )
+    {
+        this->state = saved;
+    }
+
+    inline Iterator begin()
+    {
+        return Iterator( this );
+    }
+
+    inline Iterator end()
+    {
+        return Iterator();
+    }
+};
@@ -1,229 +1,434 @@
 #include "smd.hpp"
+#include "disassembler.hpp"
+#include "instrumentation.hpp"
+#include "midi_writer.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
-#include <memory>
+#include <thread>
 
-void SMD::Read( const std::string &filename )
+namespace
 {
-    if ( not std::filesystem::exists( filename ) )
+    /*
+     * Starting and joining a thread costs about as much as decoding a few KB,
+     * so every extra decode thread needs at least this much channel data.
+     * Small songs stay on the calling thread.
+     */
+    constexpr std::size_t bytesPerDecodeThread = 16 << 10;
+
+    /* Header fields are little endian, independently of the host */
+    template <typename T> T ReadLE( std::span<const unsigned char> bytes, std::size_t at )
     {
-        std::cerr << "File " << filename << " does not exist!" << std::endl;
-        exit( EXIT_FAILURE );
+        T value = 0;
+        for ( std::size_t i = 0; i < sizeof( T ); i++ )
+            value |= static_cast<T>( bytes[at + i] ) << ( 8 * i );
+        return value;
     }
+} // namespace
+
+SMD::SMD( const std::string &filename )
+{
+    Status status = this->Open( filename );
+    if ( status != Status::Ok )
+        throw SMDError( std::string( Describe( status ) ) + ": " + filename );
+}
+
+SMD::SMD( std::span<const std::byte> buffer )
+{
+    Status status = this->Load( buffer );
+    if ( status != Status::Ok )
+        throw SMDError( std::string( Describe( status ) ) + ": <memory>" );
+}
 
-    std::ifstream inputStream{ filename };
+std::string_view SMD::Describe( Status status )
+{
+    switch ( status )
+    {
+    case Status::Ok:
+        return "Ok";
+    case Status::FileNotFound:
+        return "File does not exist";
+    case Status::CannotMapFile:
+        return "Could not map file";
+    case Status::TooSmall:
+        return "File is too small to contain an SMD header";
+    case Status::BadIdentifier:
+        return "File does not contain an SMD identifier string";
+    case Status::BadHeader:
+        return "Error while parsing header";
+    case Status::CannotWriteOutput:
+        return "Could not write output file";
+    case Status::Truncated:
+        return "File is shorter than the size in its header";
+    case Status::BadChannelOffsets:
+        return "Channel offsets point outside the data chunk";
+    case Status::TruncatedInstruction:
+        return "An instruction runs past the end of its channel";
+    case Status::ExpansionLimit:
+        return "Loops expand past the playback limit";
+    }
+
+    return "Unknown error";
+}
+
+void SMD::Reset()
+{
+    this->file.Close();
+    this->data = {};
+    this->header.offset_of_channel_n.clear();
+    this->header.filename = {};
+    this->channels.clear();
+    this->events.Clear();
+    this->headerSize    = 0;
+    this->dataChunkSize = 0;
+    this->input         = {};
+    this->validated     = false;
+}
 
+SMD::Status SMD::Open( const std::string &filename )
+{
+    this->Reset();
+
+    std::error_code error;
+    if ( not std::filesystem::exists( filename, error ) )
+        return Status::FileNotFound;
+
+    {
+        StageTimer timer( StatsStage::Open );
+        if ( not this->file.Open( filename ) )
+            return Status::CannotMapFile;
+    }
+
+    return this->Parse( this->file.Bytes() );
+}
+
+SMD::Status SMD::Load( std::span<const std::byte> buffer )
+{
+    this->Reset();
+    return this->Parse( { reinterpret_cast<const unsigned char *>( buffer.data() ), buffer.size() } );
+}
+
+SMD::Status SMD::ParseHeader( std::span<const unsigned char> bytes, Header &h, unsigned int &headerSize )
+{
     /*
      *=============*
      * READ HEADER *
      *=============*
+     *----------------------------------------------------------*
+     * Fields are read in place, the data chunk is never copied *
+     *----------------------------------------------------------*
      */
-    Header h;
-    char   garbage[9];
-    inputStream.read( h.identifier, 4 );
-    std::cout << "Identifier: " << h.identifier[0] << h.identifier[1] << h.identifier[2] << h.identifier[3]
-              << std::endl;
+    constexpr std::size_t identifierAt     = 0x00;
+    constexpr std::size_t fileSizeAt       = 0x08;
+    constexpr std::size_t channelCountAt   = 0x14;
+    constexpr std::size_t filenameOffsetAt = 0x1E;
+    constexpr std::size_t dataOffsetAt     = 0x20;
+    constexpr std::size_t channelOffsetsAt = 0x22;
 
-    if ( h.identifier[0] != 's' and h.identifier[1] != 'm' and h.identifier[2] != 'd' and h.identifier[3] != 's' )
-    {
-        std::cerr << "File " << filename << " does not contain an SMD identifier string!" << std::endl;
-        exit( EXIT_FAILURE );
-    }
+    if ( bytes.size() < channelOffsetsAt )
+        return Status::TooSmall;
 
-    inputStream.read( garbage, 4 );
-    inputStream.read( (char *)&h.file_size, 4 );
-    std::cout << "File size: " << h.file_size << std::endl;
+    std::memcpy( h.identifier, bytes.data() + identifierAt, 4 );
 
-    inputStream.read( garbage, 8 );
-    inputStream.read( (char *)&h.number_of_channels, 1 );
-    std::cout << "Number of channels: " << (unsigned int)h.number_of_channels << std::endl;
+    if ( std::memcmp( h.identifier, "smds", 4 ) != 0 )
+        return Status::BadIdentifier;
 
-    inputStream.read( garbage, 9 );
-    inputStream.read( (char *)&h.offset_of_filename, 2 );
-    std::cout << "Offset to filename: " << h.offset_of_filename << std::endl;
+    h.file_size            = ReadLE<unsigned int>( bytes, fileSizeAt );
+    h.number_of_channels   = bytes[channelCountAt];
+    h.offset_of_filename   = ReadLE<unsigned short>( bytes, filenameOffsetAt );
+    h.offset_of_data_chunk = ReadLE<unsigned short>( bytes, dataOffsetAt );
 
-    inputStream.read( (char *)&h.offset_of_data_chunk, 2 );
-    std::cout << "Offset to data chunk: " << h.offset_of_data_chunk << std::endl;
+    std::size_t at = channelOffsetsAt;
+    if ( bytes.size() < at + 2 * ( h.number_of_channels + 1 ) )
+        return Status::BadHeader;
 
-    for ( unsigned char i = 0; i < h.number_of_channels; i++ )
-    {
-        unsigned short offset;
-        inputStream.read( (char *)&offset, 2 );
-        std::cout << "Offset to channel " << (unsigned int)i << ": " << offset << std::endl;
-        h.offset_of_channel_n.push_back( offset );
-    }
+    h.offset_of_channel_n.clear();
+    for ( unsigned char i = 0; i < h.number_of_channels; i++, at += 2 )
+        h.offset_of_channel_n.push_back( ReadLE<unsigned short>( bytes, at ) );
 
-    unsigned short endOfOffsets;
-    inputStream.read( (char *)&endOfOffsets, 2 );
+    unsigned short endOfOffsets = ReadLE<unsigned short>( bytes, at );
+    at += 2;
     if ( endOfOffsets != 0 )
-    {
-        std::cerr << "Error while parsing header of file " << filename << std::endl;
-        exit( EXIT_FAILURE );
-    }
+        return Status::BadHeader;
 
-    char *b = new char;
-    do
-    {
-        inputStream.read( b, 1 );
-        h.filename.push_back( *b );
-    } while ( *b != '\0' );
+    const void *terminator = std::memchr( bytes.data() + at, '\0', bytes.size() - at );
+    if ( terminator == nullptr )
+        return Status::BadHeader;
 
-    std::cout << "Filename: " << h.filename << std::endl;
-    this->header = h;
+    h.filename = std::string_view( reinterpret_cast<const char *>( bytes.data() + at ),
+                                   static_cast<const unsigned char *>( terminator ) - ( bytes.data() + at ) );
+
+    /* The data chunk starts right after the filename's terminator */
+    headerSize = at + h.filename.size() + 1;
+    return Status::Ok;
+}
+
+SMD::Status SMD::Parse( std::span<const unsigned char> bytes )
+{
+    unsigned int headerSize = 0;
+    Status       status;
+    {
+        StageTimer timer( StatsStage::ParseHeader );
+        status = ParseHeader( bytes, this->header, headerSize );
+    }
+    if ( status != Status::Ok )
+        return status;
 
-    unsigned int headerSize = ( sizeof( char ) * 4 ) + sizeof( unsigned int ) + sizeof( unsigned char ) +
-                              sizeof( unsigned short ) + sizeof( unsigned short ) +
-                              ( sizeof( unsigned short ) * h.offset_of_channel_n.size() ) + h.filename.size() + 4 + 8 +
-                              9 + 2;
+    StageTimer timer( StatsStage::ReadData );
+    CountBytes( bytes.size() );
 
-    this->dataChunkSize = h.file_size - headerSize;
+    std::size_t end = std::min<std::size_t>( this->header.file_size, bytes.size() );
 
-    std::printf( "Data chunk size: 0x%x\n", dataChunkSize );
-    std::printf( "Header size: 0x%x\n", headerSize );
+    this->headerSize    = headerSize;
+    this->dataChunkSize = end > headerSize ? end - headerSize : 0;
 
     /*
      *===========*
      * READ DATA *
      *===========*
      */
-    this->data = std::make_unique<std::vector<unsigned char>>( dataChunkSize );
-    inputStream.read( (char *)this->data->data(), dataChunkSize );
+    this->data = bytes.subspan( headerSize, this->dataChunkSize );
+    this->FindChannels();
 
-    /*
-     *=============*
-     * END OF FILE *
-     *=============*
-     */
-    inputStream.close();
+    this->input     = bytes;
+    this->validated = this->Validate() == Status::Ok;
+
+    return Status::Ok;
 }
 
-void SMD::PrintNote( unsigned char note )
+void SMD::PrintHeader() const
 {
-    std::printf( "[0x%x]: Play note ", (unsigned int)note );
-    auto b = NextByte();
+    const Header &h = this->header;
+
+    std::cout << "Identifier: " << h.identifier[0] << h.identifier[1] << h.identifier[2] << h.identifier[3]
+              << std::endl;
+    std::cout << "File size: " << h.file_size << std::endl;
+    std::cout << "Number of channels: " << (unsigned int)h.number_of_channels << std::endl;
+    std::cout << "Offset to filename: " << h.offset_of_filename << std::endl;
+    std::cout << "Offset to data chunk: " << h.offset_of_data_chunk << std::endl;
+
+    for ( std::size_t i = 0; i < h.offset_of_channel_n.size(); i++ )
+        std::cout << "Offset to channel " << i << ": " << h.offset_of_channel_n[i] << std::endl;
 
-    if ( b.has_value() )
+    std::cout << "Filename: " << h.filename << std::endl;
+    std::printf( "Data chunk size: 0x%x\n", this->dataChunkSize );
+    std::printf( "Header size: 0x%x\n", this->headerSize );
+}
+
+bool SMD::ChannelOffsetsValid( const Header &header, unsigned int begin, unsigned int end )
+{
+    for ( unsigned short offset : header.offset_of_channel_n )
     {
-        std::printf( "0x%x", (unsigned int)b.value() );
-        if ( b.value() % 0x13 == 0 )
-        {
-            b.reset();
-            b = NextByte();
+        if ( offset < begin or offset > end )
+            return false;
+    }
 
-            if ( b.has_value() )
-                std::printf( " 0x%x", (unsigned int)b.value() );
-        }
-        std::cout << std::endl;
+    return not header.offset_of_channel_n.empty();
+}
+
+unsigned int SMD::ChannelEnd( const Header &header, std::size_t channel, unsigned int end )
+{
+    const unsigned short offset = header.offset_of_channel_n[channel];
+
+    unsigned int next = end;
+    for ( unsigned short other : header.offset_of_channel_n )
+    {
+        if ( other > offset and other < next )
+            next = other;
     }
+
+    return next;
 }
 
-void SMD::PrintInstruction( unsigned char                                       code,
-                            std::string                                         message,
-                            unsigned int                                        num_parameters,
-                            std::function<void( std::optional<unsigned char> )> additionalFunctionality )
+void SMD::FindChannels()
 {
-    std::printf( "[0x%x]: %s", (unsigned int)code, message.c_str() );
+    /* If the offset table cannot be trusted, the whole chunk is decoded as a single stream instead */
+    this->channels.clear();
 
-    for ( unsigned int i = 0; i < num_parameters; i++ )
+    const unsigned int begin = this->headerSize;
+    const unsigned int end   = this->headerSize + this->dataChunkSize;
+
+    if ( not ChannelOffsetsValid( this->header, begin, end ) )
+    {
+        this->channels.assign( 1, this->data );
+        return;
+    }
+
+    for ( std::size_t i = 0; i < this->header.offset_of_channel_n.size(); i++ )
     {
-        auto byte = NextByte();
+        const unsigned short offset = this->header.offset_of_channel_n[i];
+        this->channels.push_back( this->data.subspan( offset - begin, ChannelEnd( this->header, i, end ) - offset ) );
+    }
+}
+
+SMD::Status SMD::Validate() const
+{
+    if ( this->header.file_size > this->input.size() )
+        return Status::Truncated;
 
-        if ( byte.has_value() )
+    if ( not ChannelOffsetsValid( this->header, this->headerSize, this->headerSize + this->dataChunkSize ) )
+        return Status::BadChannelOffsets;
+
+    /* Only instruction sizes matter here, so this is a plain table walk */
+    for ( const auto &channel : this->channels )
+    {
+        const unsigned char *bytes  = channel.data();
+        const std::size_t    size   = channel.size();
+        std::size_t          offset = 0;
+
+        while ( offset + 1 < size )
         {
-            std::printf( "0x%x ", (unsigned int)byte.value() );
-            additionalFunctionality( byte );
+            unsigned int length = instructionSizes[bytes[offset]];
+            if ( length == 0 )
+                length = bytes[offset + 1] % 0x13 == 0 ? 3 : 2;
+            offset += length;
         }
+
+        /* A lone last byte is fine only if it is a complete instruction */
+        if ( offset + 1 == size and instructionSizes[bytes[offset]] == 1 )
+            offset++;
+
+        if ( offset != size )
+            return Status::TruncatedInstruction;
+    }
+
+    return Status::Ok;
+}
+
+template <bool Checked>
+void SMD::DecodeChannelAs( std::span<const unsigned char> bytes, unsigned char channel, EventStream &events )
+{
+    unsigned int tick = 0;
+
+    /* An event takes at least one byte, so this never reallocates */
+    events.Reserve( events.Size() + bytes.size(), events.Channels() + 1 );
+
+    const unsigned char *at  = bytes.data();
+    const unsigned char *end = at + bytes.size();
+
+    while ( at < end )
+    {
+        Instruction instruction;
+        if constexpr ( Checked )
+            instruction = ReadInstruction( bytes, at - bytes.data() );
+        else
+            instruction = ReadInstructionUnchecked( at );
+
+        events.Push( instruction.code, instruction.num_parameters, instruction.parameters, channel, tick );
+        tick += Duration( instruction.code, instruction.num_parameters, instruction.parameters );
+        at += instruction.size;
     }
 
-    std::printf( "\n" );
+    events.EndChannel( tick );
 }
 
-std::optional<unsigned char> SMD::NextByte()
+void SMD::DecodeChannel( std::span<const unsigned char> bytes, unsigned char channel, EventStream &events )
 {
-    if ( this->offset < this->dataChunkSize )
-        return this->data->at( this->offset++ );
-    return std::optional<unsigned char>();
+    DecodeChannelAs<true>( bytes, channel, events );
 }
 
-template <int Start, int End> constexpr void SMD::GeneratePairs()
+void SMD::DecodeInto( EventStream &events, std::vector<EventStream> &scratch, unsigned int threads ) const
 {
-    if constexpr ( Start <= End )
+    /*
+     * Every channel has its own cursor and event buffer, so channels are
+     * decoded independently on a small pool of threads. The buffers are then
+     * appended in channel order, which keeps the result deterministic.
+     */
+    StageTimer  timer( StatsStage::Decode );
+    FileReport *report = PrepareChannels( this->channels.size() );
+
+    /* Inputs that passed Validate() skip every bounds check */
+    auto decode = this->validated ? DecodeChannelAs<false> : DecodeChannelAs<true>;
+
+    events.Clear();
+    events.Reserve( this->dataChunkSize, this->channels.size() );
+
+    if ( threads == 0 )
+        threads = std::thread::hardware_concurrency();
+    threads = std::min<std::size_t>( { threads, this->channels.size(), this->dataChunkSize / bytesPerDecodeThread } );
+
+    if ( threads <= 1 )
     {
-        this->convertionTable.insert( std::pair<unsigned char, ConvFunc>( Start, [&]() { PrintNote( Start ); } ) );
-        GeneratePairs<Start + 1, End>();
+        for ( std::size_t i = 0; i < this->channels.size(); i++ )
+        {
+            ChannelTimer channelTimer( report, i );
+            decode( this->channels[i], i, events );
+        }
+        return;
     }
 
-    return;
-}
-
-void SMD::ToMIDI( const std::string &output_filename )
-{
-    this->convertionTable = {
-        std::pair<unsigned char, ConvFunc>( 0x80, [&]() { PrintInstruction( 0x80, "Rest for ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x81, [&]() { PrintInstruction( 0x81, "Extend previous note for ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x90, [&]() { PrintInstruction( 0x90, "End channel", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>(
-            0x91, [&]() { PrintInstruction( 0x91, "Loop remainder of channel indefinitely", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x94, [&]() { PrintInstruction( 0x94, "Set octave to ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x95, [&]() { PrintInstruction( 0x95, "Increment octave", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x96, [&]() { PrintInstruction( 0x96, "Decrement octave", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x97, [&]() { PrintInstruction( 0x97, "Set time signature to ", 2 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x98, [&]() { PrintInstruction( 0x98, "Begin loop, times=", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x99, [&]() { PrintInstruction( 0x99, "End loop", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0x9C, [&]() { PrintInstruction( 0x9C, "? ", 3 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xA0, [&]() { PrintInstruction( 0xA0, "Set tempo to ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>(
-            0xAC,
-            [&]()
-            {
-                PrintInstruction( 0xAC, "Set instrument to ", 1,
-                                  [&]( std::optional<unsigned char> b )
-                                  { std::printf( "Instrument = %s", this->instruments.at( b.value() ).c_str() ); } );
-            } ),
-        std::pair<unsigned char, ConvFunc>( 0xBA, [&]() { PrintInstruction( 0xBA, "Begin channel", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xBF, [&]() { PrintInstruction( 0xBF, "? ", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC0, [&]() { PrintInstruction( 0xC0, "? ", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC2, [&]() { PrintInstruction( 0xC2, "Set attack rate to ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC3, [&]() { PrintInstruction( 0xC3, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC4, [&]() { PrintInstruction( 0xC4, "Set sustain rate to ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC5, [&]() { PrintInstruction( 0xC5, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC6, [&]() { PrintInstruction( 0xC6, "Set sustain rate to ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC7, [&]() { PrintInstruction( 0xC7, "Set note volume? ", 2 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC8, [&]() { PrintInstruction( 0xC8, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xC9, [&]() { PrintInstruction( 0xC9, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xD2, [&]() { PrintInstruction( 0xD2, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xD7, [&]() { PrintInstruction( 0xD7, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xD8, [&]() { PrintInstruction( 0xD8, "Pitch shift ", 3 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xDA, [&]() { PrintInstruction( 0xDA, "? ", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xDB, [&]() { PrintInstruction( 0xDB, "? ", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xE0, [&]() { PrintInstruction( 0xE0, "Set volume to ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xE3, [&]() { PrintInstruction( 0xE3, "? ", 1 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xE4, [&]() { PrintInstruction( 0xE4, "? ", 3 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xE6, [&]() { PrintInstruction( 0xE6, "? ", 0 ); } ),
-        std::pair<unsigned char, ConvFunc>( 0xE8, [&]() { PrintInstruction( 0xE8, "Set balance ", 1 ); } ) };
-
-    GeneratePairs<0x00, 0x7F>();
+    if ( scratch.size() < this->channels.size() )
+        scratch.resize( this->channels.size() );
+
+    std::atomic<std::size_t> next = 0;
+
+    auto worker = [&]()
+    {
+        for ( std::size_t i = next++; i < this->channels.size(); i = next++ )
+        {
+            ChannelTimer channelTimer( report, i );
+            scratch[i].Clear();
+            decode( this->channels[i], i, scratch[i] );
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve( threads - 1 );
+    for ( std::size_t i = 1; i < threads; i++ )
+        pool.emplace_back( worker );
+
+    worker();
+
+    for ( auto &thread : pool )
+        thread.join();
+
+    for ( std::size_t i = 0; i < this->channels.size(); i++ )
+        events.Append( scratch[i] );
+}
+
+void SMD::Decode( EventStream &events, unsigned int threads ) const
+{
+    std::vector<EventStream> scratch;
+    this->DecodeInto( events, scratch, threads );
+}
+
+const EventStream &SMD::Decode( unsigned int threads )
+{
+    this->DecodeInto( this->events, this->scratch, threads );
+    return this->events;
+}
+
+void SMD::Disassemble( const EventStream &events ) const
+{
+    Disassembler disassembler;
+    disassembler.Write( events );
+}
 
+void SMD::Disassemble( unsigned int threads )
+{
+    this->Disassemble( this->Decode( threads ) );
+}
 
+SMD::Status SMD::ToMIDI( const std::string &output_filename, unsigned int max_forever_repeats )
+{
     /*
      *===============================*
      * READ AND EXECUTE INSTRUCTIONS *
      *===============================*
-     *---------------------------------------------------------*
-     * For now it only prints the instructions into the stdout *
-     *---------------------------------------------------------*
+     *-----------------------------------------------------------------------------*
+     * A conductor MTrk, then one per channel, see MidiTrack for the MIDI channels *
+     *-----------------------------------------------------------------------------*
      */
-    std::optional<unsigned char> b;
-    do
-    {
-        b.reset();
-        b = NextByte();
+    StageTimer timer( StatsStage::Output );
+    if ( not BuildTracks( *this, this->tracks, max_forever_repeats ) )
+        return Status::ExpansionLimit;
 
-        if ( b.has_value() )
-        {
-            this->convertionTable[b.value()]();
-        }
-    } while ( b.has_value() );
+    std::span<const MidiTrack> written( this->tracks.data(), this->channels.size() + 1 );
+    if ( not WriteMidiFile( output_filename, written ) )
+        return Status::CannotWriteOutput;
+
+    return Status::Ok;
 }
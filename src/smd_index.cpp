@@ -0,0 +1,95 @@
+#include "smd_index.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    bool ReadAt( int fd, unsigned char *out, std::size_t size, off_t offset )
+    {
+        while ( size > 0 )
+        {
+            ssize_t count = ::pread( fd, out, size, offset );
+            if ( count < 0 and errno == EINTR )
+                continue;
+            if ( count <= 0 )
+                return false;
+
+            out += count;
+            size -= count;
+            offset += count;
+        }
+
+        return true;
+    }
+} // namespace
+
+SMDIndex::~SMDIndex()
+{
+    this->Close();
+}
+
+void SMDIndex::Close()
+{
+    if ( this->fd >= 0 )
+        ::close( this->fd );
+
+    this->fd = -1;
+    this->headerBytes.clear();
+    this->header.offset_of_channel_n.clear();
+    this->header.filename = {};
+    this->headerSize      = 0;
+    this->dataEnd         = 0;
+    this->validOffsets    = false;
+}
+
+SMD::Status SMDIndex::Open( const std::string &filename )
+{
+    this->Close();
+
+    this->fd = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( this->fd < 0 )
+        return errno == ENOENT ? SMD::Status::FileNotFound : SMD::Status::CannotMapFile;
+
+    struct stat st;
+    if ( ::fstat( this->fd, &st ) != 0 or not S_ISREG( st.st_mode ) )
+        return SMD::Status::CannotMapFile;
+
+    this->headerBytes.resize( std::min<std::size_t>( st.st_size, headerReadSize ) );
+    if ( not ReadAt( this->fd, this->headerBytes.data(), this->headerBytes.size(), 0 ) )
+        return SMD::Status::CannotMapFile;
+
+    SMD::Status status = SMD::ParseHeader( this->headerBytes, this->header, this->headerSize );
+    if ( status != SMD::Status::Ok )
+        return status;
+
+    this->dataEnd      = std::max<std::size_t>( std::min<std::size_t>( this->header.file_size, st.st_size ),
+                                                this->headerSize );
+    this->validOffsets = SMD::ChannelOffsetsValid( this->header, this->headerSize, this->dataEnd );
+    return SMD::Status::Ok;
+}
+
+std::size_t SMDIndex::Channels() const
+{
+    return this->validOffsets ? this->header.offset_of_channel_n.size() : 1;
+}
+
+SMD::Status SMDIndex::LoadChannel( std::size_t channel, std::vector<unsigned char> &bytes ) const
+{
+    unsigned int begin = this->headerSize;
+    unsigned int end   = this->dataEnd;
+
+    if ( this->validOffsets )
+    {
+        begin = this->header.offset_of_channel_n.at( channel );
+        end   = SMD::ChannelEnd( this->header, channel, this->dataEnd );
+    }
+
+    bytes.resize( end - begin );
+    if ( not ReadAt( this->fd, bytes.data(), bytes.size(), begin ) )
+        return SMD::Status::CannotMapFile;
+
+    return SMD::Status::Ok;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "smd.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Header-only view of an SMD file. Open() costs a single small read and
+ * never touches the data chunk; channels are read one at a time, by offset,
+ * only when asked for. Channel n is the same byte range SMD::Channels()
+ * would give, including the whole-chunk fallback for unusable offsets.
+ */
+class SMDIndex
+{
+private:
+    static constexpr std::size_t headerReadSize = 4096;
+
+    int                        fd = -1;
+    std::vector<unsigned char> headerBytes;
+    SMD::Header                header;
+    unsigned int               headerSize   = 0;
+    unsigned int               dataEnd      = 0;
+    bool                       validOffsets = false;
+
+public:
+    SMDIndex() = default;
+    SMDIndex( const SMDIndex & )            = delete;
+    SMDIndex &operator=( const SMDIndex & ) = delete;
+    ~SMDIndex();
+
+    SMD::Status Open( const std::string &filename );
+    void        Close();
+
+    inline const SMD::Header &GetHeader() const
+    {
+        return this->header;
+    }
+
+    /* Bytes of the data chunk actually present in the file */
+    inline unsigned int DataChunkSize() const
+    {
+        return this->dataEnd - this->headerSize;
+    }
+
+    /* channel has to be below Channels() */
+    std::size_t Channels() const;
+    SMD::Status LoadChannel( std::size_t channel, std::vector<unsigned char> &bytes ) const;
+};
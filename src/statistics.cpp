@@ -0,0 +1,183 @@
+#include "statistics.hpp"
+#include "opcodes.hpp"
+#include "smd.hpp"
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    /*
+     * 27 is the inverse of 0x13 modulo 256, so x * 27 maps the fourteen
+     * multiples of 0x13 that fit in a byte onto 0..13 and everything else
+     * above it. That turns the modulo into a multiply and a compare.
+     */
+    inline bool IsMultipleOf13h( unsigned char x )
+    {
+        return (unsigned char)( x * 27 ) <= 13;
+    }
+
+#if defined( __AVX2__ )
+    inline std::uint64_t Classify64( const unsigned char *bytes )
+    {
+        const __m256i factor = _mm256_set1_epi16( 27 );
+        const __m256i low    = _mm256_set1_epi16( 0x00FF );
+        const __m256i limit  = _mm256_set1_epi8( 13 );
+
+        std::uint64_t mask = 0;
+        for ( int half = 0; half < 2; half++ )
+        {
+            __m256i x    = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( bytes + 32 * half ) );
+            __m256i even = _mm256_and_si256( _mm256_mullo_epi16( x, factor ), low );
+            __m256i odd  = _mm256_slli_epi16( _mm256_mullo_epi16( _mm256_srli_epi16( x, 8 ), factor ), 8 );
+            __m256i y    = _mm256_or_si256( even, odd );
+            __m256i hit  = _mm256_cmpeq_epi8( _mm256_min_epu8( y, limit ), y );
+
+            mask |= (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8( hit ) << ( 32 * half );
+        }
+
+        return mask;
+    }
+#elif defined( __SSE2__ )
+    inline std::uint64_t Classify64( const unsigned char *bytes )
+    {
+        const __m128i factor = _mm_set1_epi16( 27 );
+        const __m128i low    = _mm_set1_epi16( 0x00FF );
+        const __m128i limit  = _mm_set1_epi8( 13 );
+
+        std::uint64_t mask = 0;
+        for ( int quarter = 0; quarter < 4; quarter++ )
+        {
+            __m128i x    = _mm_loadu_si128( reinterpret_cast<const __m128i *>( bytes + 16 * quarter ) );
+            __m128i even = _mm_and_si128( _mm_mullo_epi16( x, factor ), low );
+            __m128i odd  = _mm_slli_epi16( _mm_mullo_epi16( _mm_srli_epi16( x, 8 ), factor ), 8 );
+            __m128i y    = _mm_or_si128( even, odd );
+            __m128i hit  = _mm_cmpeq_epi8( _mm_min_epu8( y, limit ), y );
+
+            mask |= (std::uint64_t)(std::uint32_t)_mm_movemask_epi8( hit ) << ( 16 * quarter );
+        }
+
+        return mask;
+    }
+#else
+    inline std::uint64_t Classify64( const unsigned char *bytes )
+    {
+        std::uint64_t mask = 0;
+        for ( int i = 0; i < 64; i++ )
+            mask |= (std::uint64_t)IsMultipleOf13h( bytes[i] ) << i;
+        return mask;
+    }
+#endif
+} // namespace
+
+void OpcodeScanner::Classify( std::span<const unsigned char> bytes )
+{
+    /* One spare word, so looking one byte past the end reads a zero bit */
+    const std::size_t blocks = bytes.size() / 64;
+    this->multiplesOf13h.assign( blocks + 2, 0 );
+
+    for ( std::size_t block = 0; block < blocks; block++ )
+        this->multiplesOf13h[block] = Classify64( bytes.data() + 64 * block );
+
+    for ( std::size_t i = 64 * blocks; i < bytes.size(); i++ )
+        this->multiplesOf13h[i / 64] |= (std::uint64_t)IsMultipleOf13h( bytes[i] ) << ( i % 64 );
+}
+
+void OpcodeScanner::Scan( std::span<const unsigned char> channel, ChannelSummary &summary )
+{
+    this->Classify( channel );
+
+    const unsigned char *bytes = channel.data();
+    const std::size_t    size  = channel.size();
+    const std::uint64_t *bits  = this->multiplesOf13h.data();
+
+    for ( std::size_t at = 0; at < size; )
+    {
+        const unsigned char code = bytes[at];
+        summary.histogram[code]++;
+
+        if ( code == 0x90 and not summary.end_of_channel.has_value() )
+            summary.end_of_channel = at;
+
+        std::size_t length = instructionSizes[code];
+        if ( length == 0 )
+        {
+            const std::size_t parameter = at + 1;
+            length                      = 2 + ( ( bits[parameter / 64] >> ( parameter % 64 ) ) & 1 );
+        }
+
+        at += length;
+    }
+
+    for ( unsigned int code = 0; code < 256; code++ )
+    {
+        const std::size_t count = summary.histogram[code];
+        summary.opcodes += count;
+
+        switch ( opcodes[code].kind )
+        {
+        case OpcodeKind::Note:
+            summary.notes += count;
+            break;
+        case OpcodeKind::Rest:
+            summary.rests += count;
+            break;
+        case OpcodeKind::Extend:
+            summary.extensions += count;
+            break;
+        case OpcodeKind::BeginLoop:
+            summary.loops += count;
+            break;
+        case OpcodeKind::EndLoop:
+            summary.loop_ends += count;
+            break;
+        case OpcodeKind::LoopForever:
+            summary.loops_forever += count;
+            break;
+        case OpcodeKind::Tempo:
+            summary.tempo_changes += count;
+            break;
+        case OpcodeKind::Instrument:
+            summary.instrument_changes += count;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+SongStatistics OpcodeScanner::Scan( const SMD &smd )
+{
+    SongStatistics statistics;
+    statistics.channels.resize( smd.Channels().size() );
+
+    for ( std::size_t c = 0; c < smd.Channels().size(); c++ )
+    {
+        this->Scan( smd.Channels()[c], statistics.channels[c] );
+
+        for ( unsigned int code = 0; code < 256; code++ )
+            statistics.histogram[code] += statistics.channels[c].histogram[code];
+    }
+
+    return statistics;
+}
+
+void PrintSummary( std::ostream &out, const SongStatistics &statistics )
+{
+    for ( std::size_t c = 0; c < statistics.channels.size(); c++ )
+    {
+        const ChannelSummary &summary = statistics.channels[c];
+        out << "  channel " << c << ": " << summary.opcodes << " opcodes, " << summary.notes << " notes, "
+            << summary.rests << " rests, " << summary.extensions << " extensions, " << summary.loops << " loops, "
+            << summary.loops_forever << " endless loops, " << summary.tempo_changes << " tempo changes, "
+            << summary.instrument_changes << " instrument changes, ";
+
+        if ( summary.end_of_channel.has_value() )
+            out << "ends at " << summary.end_of_channel.value() << '\n';
+        else
+            out << "no end of channel\n";
+    }
+}
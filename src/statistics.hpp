@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <vector>
+
+class SMD;
+
+struct ChannelSummary
+{
+    std::array<std::uint32_t, 256> histogram          = {};
+    std::size_t                    opcodes            = 0;
+    std::size_t                    notes              = 0;
+    std::size_t                    rests              = 0;
+    std::size_t                    extensions         = 0;
+    std::size_t                    loops              = 0;
+    std::size_t                    loop_ends          = 0;
+    std::size_t                    loops_forever      = 0;
+    std::size_t                    tempo_changes      = 0;
+    std::size_t                    instrument_changes = 0;
+    /* Offset of the first 0x90 "End channel" from the start of the channel */
+    std::optional<unsigned int>    end_of_channel;
+};
+
+struct SongStatistics
+{
+    std::array<std::size_t, 256> histogram = {};
+    std::vector<ChannelSummary>  channels;
+};
+
+/*
+ * Counts opcodes without going through the decoder. Bytes are classified
+ * with SIMD (AVX2 or SSE2 when the compiler targets them, plain C++
+ * otherwise) into a bitmap of "multiple of 0x13" bytes, which is the only
+ * thing that makes a note's length depend on its data. The walk over the
+ * instructions then only needs table lookups and bit tests, and it skips
+ * parameters exactly like ReadInstruction() so they are never counted as
+ * opcodes.
+ */
+class OpcodeScanner
+{
+private:
+    std::vector<std::uint64_t> multiplesOf13h;
+
+    void Classify( std::span<const unsigned char> bytes );
+
+public:
+    void           Scan( std::span<const unsigned char> channel, ChannelSummary &summary );
+    SongStatistics Scan( const SMD &smd );
+};
+
+/* One line per channel, as printed by --summary */
+void PrintSummary( std::ostream &out, const SongStatistics &statistics );
@@ -0,0 +1,162 @@
+#include "timeline.hpp"
+#include "midi_writer.hpp"
+#include "smd.hpp"
+#include <algorithm>
+#include <limits>
+
+void Timeline::ChannelState::Apply( const Instruction &instruction )
+{
+    if ( instruction.num_parameters < opcodes[instruction.code].num_parameters )
+        return;
+
+    switch ( opcodes[instruction.code].kind )
+    {
+    case OpcodeKind::SetOctave:
+        this->octave = instruction.parameters[0];
+        break;
+    case OpcodeKind::IncrementOctave:
+        this->octave++;
+        break;
+    case OpcodeKind::DecrementOctave:
+        this->octave--;
+        break;
+    case OpcodeKind::Instrument:
+        this->instrument = instruction.parameters[0];
+        break;
+    case OpcodeKind::Volume:
+        this->volume = instruction.parameters[0];
+        break;
+    case OpcodeKind::Balance:
+        this->balance = instruction.parameters[0];
+        break;
+    case OpcodeKind::AttackRate:
+        this->attack = instruction.parameters[0];
+        break;
+    case OpcodeKind::SustainRate:
+        this->sustain = instruction.parameters[0];
+        break;
+    default:
+        break;
+    }
+}
+
+Timeline::Timeline( const SMD &smd, unsigned int interval, unsigned int max_forever_repeats )
+    : smd( &smd ), maxForeverRepeats( max_forever_repeats )
+{
+    const std::size_t channels = smd.Channels().size();
+    interval                   = std::max( interval, 1u );
+
+    this->checkpoints.resize( channels );
+    this->lengths.resize( channels );
+
+    for ( std::size_t c = 0; c < channels; c++ )
+    {
+        LoopSequencer sequencer = smd.Sequence( c, max_forever_repeats );
+        ChannelState  state;
+        unsigned int  next = 0;
+
+        for ( ;; )
+        {
+            const LoopSequencer::State saved = sequencer.GetState();
+            auto                       step  = sequencer.Next();
+            if ( not step.has_value() )
+                break;
+
+            if ( step->tick >= next )
+            {
+                this->checkpoints[c].push_back( Checkpoint{ step->tick, saved, state } );
+                next = step->tick - step->tick % interval + interval;
+            }
+
+            state.Apply( step->instruction );
+
+            if ( opcodes[step->instruction.code].kind == OpcodeKind::Tempo and step->instruction.num_parameters > 0 and
+                 step->instruction.parameters[0] > 0 )
+                this->tempo.push_back( TempoChange{ step->tick, step->instruction.parameters[0], 0 } );
+        }
+
+        this->lengths[c] = sequencer.GetState().tick;
+        this->truncated  = this->truncated or sequencer.Truncated();
+    }
+
+    /* Channels are walked one after the other, so their tempo changes are merged here */
+    std::stable_sort( this->tempo.begin(), this->tempo.end(),
+                      []( const TempoChange &a, const TempoChange &b ) { return a.tick < b.tick; } );
+    this->tempo.insert( this->tempo.begin(), TempoChange{ 0, defaultBPM, 0 } );
+
+    for ( std::size_t i = 1; i < this->tempo.size(); i++ )
+    {
+        const TempoChange &previous = this->tempo[i - 1];
+        this->tempo[i].seconds      = previous.seconds + ( this->tempo[i].tick - previous.tick ) * 60.0 /
+                                                        ( previous.bpm * (double)MidiTrack::division );
+    }
+}
+
+double Timeline::Seconds( unsigned int tick ) const
+{
+    auto change = std::upper_bound( this->tempo.begin(), this->tempo.end(), tick,
+                                    []( unsigned int t, const TempoChange &c ) { return t < c.tick; } ) -
+                  1;
+
+    return change->seconds + ( tick - change->tick ) * 60.0 / ( change->bpm * (double)MidiTrack::division );
+}
+
+unsigned int Timeline::Tick( double seconds ) const
+{
+    /* Checked first: the search below steps back from begin() for negative times. NaN lands here too */
+    if ( not ( seconds > 0 ) )
+        return 0;
+
+    auto change = std::upper_bound( this->tempo.begin(), this->tempo.end(), seconds,
+                                    []( double s, const TempoChange &c ) { return s < c.seconds; } ) -
+                  1;
+
+    double tick = change->tick + ( seconds - change->seconds ) * change->bpm * MidiTrack::division / 60.0;
+
+    /* Converting a double out of range is undefined, times past the last tick saturate instead */
+    if ( tick >= (double)std::numeric_limits<unsigned int>::max() )
+        return std::numeric_limits<unsigned int>::max();
+
+    return (unsigned int)tick;
+}
+
+Timeline::Position Timeline::Seek( std::size_t channel, unsigned int tick ) const
+{
+    const std::vector<Checkpoint> &index = this->checkpoints.at( channel );
+
+    Position position{ this->smd->Sequence( channel, this->maxForeverRepeats ), ChannelState() };
+
+    auto checkpoint = std::upper_bound( index.begin(), index.end(), tick,
+                                        []( unsigned int t, const Checkpoint &c ) { return t < c.tick; } );
+    if ( checkpoint != index.begin() )
+    {
+        --checkpoint;
+        position.sequencer.Restore( checkpoint->sequencer );
+        position.state = checkpoint->state;
+    }
+
+    /* Replay up to the target, stepping back once an instruction starts at or after it */
+    for ( ;; )
+    {
+        const LoopSequencer::State saved = position.sequencer.GetState();
+        auto                       step  = position.sequencer.Next();
+
+        if ( not step.has_value() )
+            break;
+
+        if ( step->tick >= tick )
+        {
+            position.sequencer.Restore( saved );
+            break;
+        }
+
+        position.state.Apply( step->instruction );
+    }
+
+    return position;
+}
+
+Timeline::Position Timeline::SeekSeconds( std::size_t channel, double seconds ) const
+{
+    return this->Seek( channel, this->Tick( seconds ) );
+}
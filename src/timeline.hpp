@@ -0,0 +1,96 @@
+#pragma once
+
+#include "sequencer.hpp"
+#include <cstddef>
+#include <vector>
+
+class SMD;
+
+/*
+ * Playback timeline of a song with its loops expanded. Tempo changes from
+ * any channel apply to the whole song from the tick they happen at, which
+ * gives the wall-clock time of every tick. Each channel also gets a sparse
+ * seek index: a checkpoint of the full decoder state every `interval`
+ * ticks, so playback can start anywhere after a binary search and a short
+ * replay instead of decoding from the first byte.
+ */
+class Timeline
+{
+public:
+    static constexpr unsigned int defaultBPM = 120;
+
+    /* Decoder state the sequencer itself does not track */
+    struct ChannelState
+    {
+        int           octave     = 4;
+        unsigned char instrument = 0;
+        unsigned char volume     = 0x7F;
+        unsigned char balance    = 0x40;
+        unsigned char attack     = 0;
+        unsigned char sustain    = 0;
+
+        void Apply( const Instruction &instruction );
+    };
+
+    struct Checkpoint
+    {
+        unsigned int         tick;
+        LoopSequencer::State sequencer;
+        ChannelState         state;
+    };
+
+    struct TempoChange
+    {
+        unsigned int tick;
+        unsigned int bpm;
+        double       seconds;
+    };
+
+    /* A channel ready to play from a given tick */
+    struct Position
+    {
+        LoopSequencer sequencer;
+        ChannelState  state;
+    };
+
+private:
+    const SMD                           *smd               = nullptr;
+    unsigned int                         maxForeverRepeats = 0;
+    std::vector<TempoChange>             tempo;
+    std::vector<std::vector<Checkpoint>> checkpoints;
+    std::vector<unsigned int>            lengths;
+    bool                                 truncated         = false;
+
+public:
+    /* The SMD has to outlive the timeline */
+    Timeline( const SMD &smd, unsigned int interval = 192, unsigned int max_forever_repeats = 0 );
+
+    double       Seconds( unsigned int tick ) const;
+    unsigned int Tick( double seconds ) const;
+
+    inline std::size_t Channels() const
+    {
+        return this->lengths.size();
+    }
+
+    /* Whether any channel was cut short at LoopSequencer's limits */
+    inline bool Truncated() const
+    {
+        return this->truncated;
+    }
+
+    /* Length of a channel in ticks, loops included */
+    inline unsigned int Length( std::size_t channel ) const
+    {
+        return this->lengths[channel];
+    }
+
+    inline const std::vector<TempoChange> &TempoMap() const
+    {
+        return this->tempo;
+    }
+
+    /* Positions a channel on its first instruction that starts at or after `tick` */
+    Position Seek( std::size_t channel, unsigned int tick ) const;
+    Position SeekSeconds( std::size_t channel, double seconds ) const;
+};
@@ -0,0 +1,172 @@
+#include "event_cache.hpp"
+#include "smd.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /* A minimal SMD around the given channels, laid out like the generator in bench/ */
+    std::vector<unsigned char> MakeSMD( const std::vector<std::vector<unsigned char>> &channels )
+    {
+        const std::size_t headerSize = 0x22 + 2 * ( channels.size() + 1 ) + 1;
+
+        std::vector<unsigned char> out( headerSize, 0 );
+        out[0] = 's';
+        out[1] = 'm';
+        out[2] = 'd';
+        out[3] = 's';
+        out[0x14] = channels.size();
+        out[0x1E] = headerSize - 1;
+        out[0x20] = headerSize;
+
+        for ( std::size_t c = 0; c < channels.size(); c++ )
+        {
+            out[0x22 + 2 * c]     = out.size() & 0xFF;
+            out[0x22 + 2 * c + 1] = out.size() >> 8;
+            out.insert( out.end(), channels[c].begin(), channels[c].end() );
+        }
+
+        out[0x08] = out.size() & 0xFF;
+        out[0x09] = out.size() >> 8;
+        return out;
+    }
+
+    int failures = 0;
+
+    void Check( bool condition, const char *what )
+    {
+        if ( not condition )
+        {
+            std::fprintf( stderr, "FAILED: %s\n", what );
+            failures++;
+        }
+    }
+
+    std::vector<char> ReadAll( const std::string &filename )
+    {
+        std::ifstream in( filename, std::ios::binary );
+        return { std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() };
+    }
+
+    void WriteAll( const std::string &filename, const std::vector<char> &bytes )
+    {
+        std::ofstream out( filename, std::ios::binary | std::ios::trunc );
+        out.write( bytes.data(), bytes.size() );
+    }
+
+    /* Section offsets as documented in event_cache.hpp */
+    std::size_t Align( std::size_t offset )
+    {
+        return ( offset + 7 ) & ~std::size_t( 7 );
+    }
+
+    std::size_t TicksAt( std::size_t channels )
+    {
+        return Align( sizeof( EventCache::Header ) + channels * sizeof( EventCache::Channel ) );
+    }
+
+    std::size_t NumParametersAt( std::size_t channels, std::size_t events )
+    {
+        return Align( Align( TicksAt( channels ) + events * sizeof( std::uint32_t ) ) + events );
+    }
+
+    /* Tempo, instrument, volume, a loop and a few notes and rests over two channels */
+    const std::vector<std::vector<unsigned char>> song = {
+        { 0xA0, 0x78, 0xAC, 0x05, 0x99, 0x02, 0x10, 0x01, 0x80, 0x98, 0x40, 0x29, 0x90 },
+        { 0xE0, 0x60, 0x91, 0x7F, 0x14, 0x81, 0x90 },
+    };
+
+    void RoundTrip( const std::string &path )
+    {
+        const std::vector<unsigned char> bytes = MakeSMD( song );
+        SMD                              smd( std::as_bytes( std::span( bytes ) ) );
+        const EventStream               &decoded = smd.Decode();
+
+        Check( EventCache::Write( path, decoded, 0x1234, bytes.size() ), "the cache is written" );
+
+        EventCache cache;
+        Check( cache.Open( path ), "the cache opens" );
+        Check( cache.Matches( 0x1234, bytes.size() ), "the cache matches its source" );
+        Check( not cache.Matches( 0x1234, bytes.size() + 1 ), "the cache does not match another size" );
+        Check( cache.Tempos().size() == 1 and cache.Tempos()[0].value == 0x78, "the tempo table holds the 0xA0" );
+        Check( cache.Instruments().size() == 1 and cache.Instruments()[0].value == 0x05,
+               "the instrument table holds the 0xAC" );
+
+        EventStream events;
+        cache.ToEventStream( events );
+
+        Check( events.Size() == decoded.Size(), "every event comes back" );
+        Check( events.opcode == decoded.opcode, "opcodes come back" );
+        Check( events.num_parameters == decoded.num_parameters, "parameter counts come back" );
+        Check( events.channel == decoded.channel, "channels come back" );
+        Check( events.tick == decoded.tick, "ticks come back" );
+        Check( events.channel_begin == decoded.channel_begin, "channel boundaries come back" );
+        Check( events.channel_length == decoded.channel_length, "channel lengths come back" );
+
+        bool parameters = events.Size() == decoded.Size();
+        for ( std::size_t i = 0; parameters and i < events.Size(); i++ )
+        {
+            for ( std::size_t p = 0; p < decoded.num_parameters[i]; p++ )
+                parameters = parameters and events.parameters[i][p] == decoded.parameters[i][p];
+        }
+        Check( parameters, "parameters come back" );
+    }
+
+    /* Each corruption is applied to a fresh copy of the good file, which Open() must then refuse */
+    void Corrupted( const std::string &path )
+    {
+        const std::vector<char> good = ReadAll( path );
+        EventCache              cache;
+
+        Check( cache.Open( path ), "the unmodified cache opens" );
+        const std::size_t channels = cache.Channels().size();
+        const std::size_t events   = cache.Ticks().size();
+        cache.Close();
+
+        auto refused = [&]( auto corrupt ) {
+            std::vector<char> bytes = good;
+            corrupt( bytes );
+            WriteAll( path, bytes );
+            return not cache.Open( path );
+        };
+
+        Check( refused( []( std::vector<char> &bytes ) { bytes[0] ^= 0xFF; } ), "a wrong magic is refused" );
+        Check( refused( []( std::vector<char> &bytes ) { bytes.pop_back(); } ), "a truncated cache is refused" );
+        Check( refused( [&]( std::vector<char> &bytes ) { bytes[NumParametersAt( channels, events ) + 1] = 4; } ),
+               "more than 3 parameters are refused" );
+        Check( refused( [&]( std::vector<char> &bytes ) {
+                   std::uint32_t tick = 0xFFFFFFFF;
+                   std::memcpy( &bytes[TicksAt( channels )], &tick, sizeof( tick ) );
+               } ),
+               "ticks going back within a channel are refused" );
+        Check( refused( [&]( std::vector<char> &bytes ) {
+                   EventCache::Channel first;
+                   std::memcpy( &first, &bytes[sizeof( EventCache::Header )], sizeof( first ) );
+                   first.event_count = events + 1;
+                   std::memcpy( &bytes[sizeof( EventCache::Header )], &first, sizeof( first ) );
+               } ),
+               "a channel running past the events is refused" );
+        Check( cache.Channels().empty() and cache.Ticks().empty(), "a refused cache leaves the object empty" );
+
+        WriteAll( path, good );
+        Check( cache.Open( path ), "the restored cache opens again" );
+    }
+} // namespace
+
+int main()
+{
+    const std::string path =
+        ( std::filesystem::temp_directory_path() / ( "event_cache_test." + std::to_string( getpid() ) ) ).string();
+
+    RoundTrip( path );
+    Corrupted( path );
+
+    std::filesystem::remove( path );
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,292 @@
+#include "instruments.hpp"
+#include "midi_writer.hpp"
+#include "smd.hpp"
+#include "timeline.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /* A minimal SMD around the given channels, laid out like the generator in bench/ */
+    std::vector<unsigned char> MakeSMD( const std::vector<std::vector<unsigned char>> &channels )
+    {
+        const std::size_t headerSize = 0x22 + 2 * ( channels.size() + 1 ) + 1;
+
+        std::vector<unsigned char> out( headerSize, 0 );
+        out[0] = 's';
+        out[1] = 'm';
+        out[2] = 'd';
+        out[3] = 's';
+        out[0x14] = channels.size();
+        out[0x1E] = headerSize - 1;
+        out[0x20] = headerSize;
+
+        for ( std::size_t c = 0; c < channels.size(); c++ )
+        {
+            out[0x22 + 2 * c]     = out.size() & 0xFF;
+            out[0x22 + 2 * c + 1] = out.size() >> 8;
+            out.insert( out.end(), channels[c].begin(), channels[c].end() );
+        }
+
+        out[0x08] = out.size() & 0xFF;
+        out[0x09] = out.size() >> 8;
+        return out;
+    }
+
+    int failures = 0;
+
+    void Check( bool condition, const char *what )
+    {
+        if ( not condition )
+        {
+            std::fprintf( stderr, "FAILED: %s\n", what );
+            failures++;
+        }
+    }
+
+    /* One event of an MTrk body, at its absolute tick. Meta events keep their type in data[0] */
+    struct MidiEvent
+    {
+        unsigned int               tick;
+        unsigned char              status;
+        std::vector<unsigned char> data;
+    };
+
+    /* Reads back what MidiTrack writes: no running status, only note, program change and meta events */
+    std::vector<MidiEvent> Parse( std::span<const unsigned char> bytes )
+    {
+        std::vector<MidiEvent> events;
+        std::size_t            at   = 0;
+        unsigned int           tick = 0;
+
+        while ( at < bytes.size() )
+        {
+            unsigned int delta = 0;
+            do
+                delta = ( delta << 7 ) | ( bytes[at] & 0x7F );
+            while ( bytes[at++] & 0x80 and at < bytes.size() );
+            tick += delta;
+
+            if ( at >= bytes.size() )
+                break;
+
+            MidiEvent   event{ tick, bytes[at++], {} };
+            std::size_t size = 0;
+            if ( event.status == 0xFF and at + 1 < bytes.size() )
+                size = 2 + bytes[at + 1];
+            else if ( ( event.status & 0xF0 ) == 0xC0 )
+                size = 1;
+            else
+                size = 2;
+
+            size = std::min( size, bytes.size() - at );
+            event.data.assign( bytes.begin() + at, bytes.begin() + at + size );
+            if ( event.status == 0xFF )
+                event.data.erase( event.data.begin() + 1 );
+            at += size;
+
+            events.push_back( event );
+        }
+
+        return events;
+    }
+
+    std::vector<MidiTrack> Build( const std::vector<unsigned char> &bytes, unsigned int max_forever_repeats = 0 )
+    {
+        SMD                    smd( std::as_bytes( std::span( bytes ) ) );
+        std::vector<MidiTrack> tracks;
+        Check( BuildTracks( smd, tracks, max_forever_repeats ), "the tracks are built in full" );
+        return tracks;
+    }
+
+    bool IsNoteOn( const MidiEvent &event )
+    {
+        return ( event.status & 0xF0 ) == 0x90;
+    }
+
+    bool IsNoteOff( const MidiEvent &event )
+    {
+        return ( event.status & 0xF0 ) == 0x80;
+    }
+
+    /* Every note-off ends the note sounding on its channel and key, and at most one note sounds at a time */
+    bool NotesPaired( const std::vector<MidiEvent> &events )
+    {
+        std::map<std::pair<unsigned char, unsigned char>, unsigned int> sounding;
+
+        for ( const MidiEvent &event : events )
+        {
+            auto key = std::make_pair( (unsigned char)( event.status & 0x0F ), event.data[0] );
+            if ( IsNoteOn( event ) )
+            {
+                if ( not sounding.empty() )
+                    return false;
+                sounding[key]++;
+            }
+            else if ( IsNoteOff( event ) )
+            {
+                if ( sounding.erase( key ) == 0 )
+                    return false;
+            }
+        }
+
+        return sounding.empty();
+    }
+
+    void VariableLengthDeltas()
+    {
+        /* 192 ticks take two bytes, 128 loops of 128 ticks take three */
+        auto rest  = Build( MakeSMD( { { 0x80, 0xC0, 0x90 } } ) );
+        auto loops = Build( MakeSMD( { { 0x98, 0x80, 0x80, 0x80, 0x99, 0x90 } } ) );
+        auto empty = Build( MakeSMD( { { 0x90 } } ) );
+
+        const std::vector<unsigned char> twoBytes   = { 0x81, 0x40, 0xFF, 0x2F, 0x00 };
+        const std::vector<unsigned char> threeBytes = { 0x81, 0x80, 0x00, 0xFF, 0x2F, 0x00 };
+        const std::vector<unsigned char> oneByte    = { 0x00, 0xFF, 0x2F, 0x00 };
+
+        Check( std::ranges::equal( rest[1].Bytes(), twoBytes ), "192 ticks are written as 81 40" );
+        Check( std::ranges::equal( loops[1].Bytes(), threeBytes ), "16384 ticks are written as 81 80 00" );
+        Check( std::ranges::equal( empty[1].Bytes(), oneByte ), "no delay is written as 00" );
+    }
+
+    void NotePairing()
+    {
+        /* A note, a higher one, a rest, then a note extended by 0x81 */
+        auto tracks = Build( MakeSMD( { { 0x64, 0x01, 0x95, 0x64, 0x14, 0x80, 0x30, 0x64, 0x09, 0x81, 0x10, 0x90 } } ) );
+        auto events = Parse( tracks[1].Bytes() );
+
+        std::vector<MidiEvent> ons, offs;
+        for ( const MidiEvent &event : events )
+        {
+            if ( IsNoteOn( event ) )
+                ons.push_back( event );
+            else if ( IsNoteOff( event ) )
+                offs.push_back( event );
+        }
+
+        Check( NotesPaired( events ), "every note-on is followed by its note-off" );
+        Check( ons.size() == 3 and offs.size() == 3, "three notes are played" );
+        if ( ons.size() != 3 or offs.size() != 3 )
+            return;
+
+        Check( ons[0].data[0] == 60 and ons[1].data[0] == 73, "keys follow the octave and the pitch" );
+        Check( ons[0].data[1] == 0x64, "the opcode is the velocity" );
+        Check( offs[0].tick == 0xC0 and ons[1].tick == 0xC0, "a note sounds for its length" );
+        Check( offs[1].tick == 0x180 and ons[2].tick == 0x1B0, "a rest releases the note before it" );
+        Check( offs[2].tick == 0x1B0 + 0x18 + 0x10, "0x81 pushes the note-off further" );
+    }
+
+    void DrumRouting()
+    {
+        /* Melodic, two drum hits, then melodic again */
+        auto tracks = Build( MakeSMD( { {}, { 0xAC, 0x07, 0x64, 0x01, 0xAC, 0x66, 0x64, 0x01, 0x64, 0x14, 0xAC, 0x07,
+                                              0x64, 0x01, 0x90 } } ) );
+        auto events = Parse( tracks[2].Bytes() );
+
+        std::vector<MidiEvent> ons;
+        std::size_t            programs = 0;
+        for ( const MidiEvent &event : events )
+        {
+            if ( IsNoteOn( event ) )
+                ons.push_back( event );
+            else if ( event.status == 0xC1 and event.data[0] == instruments[0x07].program )
+                programs++;
+        }
+
+        Check( NotesPaired( events ), "notes are released on the channel they played on" );
+        Check( programs == 2, "melodic instruments send a program change on the track's channel" );
+        Check( ons.size() == 4, "four notes are played" );
+        if ( ons.size() != 4 )
+            return;
+
+        Check( ons[0].status == 0x91 and ons[3].status == 0x91, "melodic notes play on the track's channel" );
+        Check( ons[1].status == 0x90 + MidiTrack::drums and ons[2].status == 0x90 + MidiTrack::drums,
+               "drum notes play on channel 10" );
+        Check( ons[1].data[0] == instruments[0x66].drum_key and ons[2].data[0] == instruments[0x66].drum_key,
+               "drum notes play the instrument's key whatever their pitch" );
+    }
+
+    void LoopExpansion()
+    {
+        auto tracks = Build( MakeSMD( { { 0x98, 0x03, 0x64, 0x01, 0x99, 0x90 } } ) );
+
+        std::vector<unsigned int> ticks;
+        for ( const MidiEvent &event : Parse( tracks[1].Bytes() ) )
+        {
+            if ( IsNoteOn( event ) )
+                ticks.push_back( event.tick );
+        }
+
+        Check( ticks == std::vector<unsigned int>{ 0, 0xC0, 0x180 }, "a loop of three plays its note three times" );
+    }
+
+    /* Every track ends where Timeline ends its channel, and the conductor holds every tempo change in order */
+    void TrackLengths( const std::string &path )
+    {
+        const std::vector<unsigned char> bytes = MakeSMD( {
+            { 0xA0, 0x78, 0x64, 0x01, 0x91, 0x98, 0x02, 0x64, 0x03, 0x99, 0x80, 0x10, 0x90 },
+            { 0x80, 0x30, 0xA0, 0x01, 0x64, 0x09, 0x81, 0x20, 0x90 },
+            { 0x64, 0x01, 0x80, 0x30, 0x90 },
+        } );
+
+        SMD                    smd( std::as_bytes( std::span( bytes ) ) );
+        const Timeline         timeline( smd, 192, 2 );
+        std::vector<MidiTrack> tracks;
+        BuildTracks( smd, tracks, 2 );
+
+        bool lengths = true;
+        for ( std::size_t c = 0; c < smd.Channels().size(); c++ )
+        {
+            auto events = Parse( tracks[c + 1].Bytes() );
+            lengths     = lengths and not events.empty() and events.back().status == 0xFF and
+                      events.back().data[0] == 0x2F and events.back().tick == timeline.Length( c );
+        }
+        Check( lengths, "every track ends at its channel's length in the timeline" );
+
+        std::vector<std::pair<unsigned int, unsigned int>> tempo;
+        for ( const MidiEvent &event : Parse( tracks[0].Bytes() ) )
+        {
+            if ( event.status == 0xFF and event.data[0] == 0x51 and event.data.size() == 4 )
+                tempo.push_back( { event.tick, event.data[1] << 16 | event.data[2] << 8 | event.data[3] } );
+        }
+
+        /* 60000000 / 1 would not fit the meta event's 24 bits */
+        const std::vector<std::pair<unsigned int, unsigned int>> expected = { { 0, 500000 }, { 0x30, 0xFFFFFF } };
+        Check( tempo == expected, "the conductor track holds every tempo change, clamped to 24 bits" );
+
+        Check( smd.ToMIDI( path, 2 ) == SMD::Status::Ok, "the song converts" );
+
+        std::ifstream              in( path, std::ios::binary );
+        std::vector<unsigned char> file{ std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() };
+
+        const std::vector<unsigned char> header = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 4, 0,
+                                                    MidiTrack::division };
+        Check( file.size() > header.size() and std::equal( header.begin(), header.end(), file.begin() ),
+               "the file is type 1 with a conductor and one track per channel" );
+        Check( file.size() >= 22 + tracks[0].Bytes().size() and std::ranges::equal( std::span( file ).subspan( 22, tracks[0].Bytes().size() ),
+                                                        tracks[0].Bytes() ),
+               "the conductor is the first track" );
+    }
+} // namespace
+
+int main()
+{
+    const std::string path =
+        ( std::filesystem::temp_directory_path() / ( "midi_writer_test." + std::to_string( getpid() ) ) ).string();
+
+    VariableLengthDeltas();
+    NotePairing();
+    DrumRouting();
+    LoopExpansion();
+    TrackLengths( path );
+
+    std::filesystem::remove( path );
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
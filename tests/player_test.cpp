@@ -0,0 +1,94 @@
+#include "player.hpp"
+#include "smd.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+    /* A minimal SMD around the given channels, laid out like the generator in bench/ */
+    std::vector<unsigned char> MakeSMD( const std::vector<std::vector<unsigned char>> &channels )
+    {
+        const std::size_t headerSize = 0x22 + 2 * ( channels.size() + 1 ) + 1;
+
+        std::vector<unsigned char> out( headerSize, 0 );
+        out[0] = 's';
+        out[1] = 'm';
+        out[2] = 'd';
+        out[3] = 's';
+        out[0x14] = channels.size();
+        out[0x1E] = headerSize - 1;
+        out[0x20] = headerSize;
+
+        for ( std::size_t c = 0; c < channels.size(); c++ )
+        {
+            out[0x22 + 2 * c]     = out.size() & 0xFF;
+            out[0x22 + 2 * c + 1] = out.size() >> 8;
+            out.insert( out.end(), channels[c].begin(), channels[c].end() );
+        }
+
+        out[0x08] = out.size() & 0xFF;
+        out[0x09] = out.size() >> 8;
+        return out;
+    }
+
+    int failures = 0;
+
+    void Check( bool condition, const char *what )
+    {
+        if ( not condition )
+        {
+            std::fprintf( stderr, "FAILED: %s\n", what );
+            failures++;
+        }
+    }
+
+    /* Drains the player, giving up after `limit` events so a regression fails instead of hanging */
+    std::vector<EventPlayer::TimedEvent> Play( const std::vector<unsigned char> &bytes, std::size_t limit )
+    {
+        SMD                                  smd( std::as_bytes( std::span( bytes ) ) );
+        EventPlayer                          player( smd );
+        std::vector<EventPlayer::TimedEvent> events;
+
+        while ( events.size() < limit )
+        {
+            auto event = player.Next();
+            if ( not event.has_value() )
+                break;
+            events.push_back( event.value() );
+        }
+
+        return events;
+    }
+
+    void EmptyForeverSection()
+    {
+        /* One note, then a 0x91 section holding nothing but the end of channel */
+        auto events = Play( MakeSMD( { { 0x10, 0x01, 0x91, 0x90 } } ), 100 );
+
+        Check( events.size() == 3, "an empty 0x91 section is played once" );
+        Check( not events.empty() and events.back().tick == 0xC0, "the channel ends after its note" );
+    }
+
+    void ZeroLengthForeverSection()
+    {
+        /* Channel 0 loops a volume change that takes no time, channel 1 plays two notes */
+        auto events = Play( MakeSMD( { { 0x91, 0xE0, 0x40, 0x90 }, { 0x10, 0x01, 0x10, 0x01, 0x90 } } ), 100 );
+
+        std::size_t notes = 0;
+        for ( const auto &event : events )
+            notes += event.channel == 1 and event.instruction.code == 0x10;
+
+        Check( events.size() < 100, "a zero-length 0x91 section ends" );
+        Check( notes == 2, "the other channels keep playing" );
+        Check( not events.empty() and events.back().tick == 0x180, "time moves past the zero-length section" );
+    }
+} // namespace
+
+int main()
+{
+    EmptyForeverSection();
+    ZeroLengthForeverSection();
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
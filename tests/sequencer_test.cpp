@@ -0,0 +1,149 @@
+#include "preview.hpp"
+#include "smd.hpp"
+#include "timeline.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    /* A minimal SMD around the given channels, laid out like the generator in bench/ */
+    std::vector<unsigned char> MakeSMD( const std::vector<std::vector<unsigned char>> &channels )
+    {
+        const std::size_t headerSize = 0x22 + 2 * ( channels.size() + 1 ) + 1;
+
+        std::vector<unsigned char> out( headerSize, 0 );
+        out[0] = 's';
+        out[1] = 'm';
+        out[2] = 'd';
+        out[3] = 's';
+        out[0x14] = channels.size();
+        out[0x1E] = headerSize - 1;
+        out[0x20] = headerSize;
+
+        for ( std::size_t c = 0; c < channels.size(); c++ )
+        {
+            out[0x22 + 2 * c]     = out.size() & 0xFF;
+            out[0x22 + 2 * c + 1] = out.size() >> 8;
+            out.insert( out.end(), channels[c].begin(), channels[c].end() );
+        }
+
+        out[0x08] = out.size() & 0xFF;
+        out[0x09] = out.size() >> 8;
+        return out;
+    }
+
+    int failures = 0;
+
+    void Check( bool condition, const char *what )
+    {
+        if ( not condition )
+        {
+            std::fprintf( stderr, "FAILED: %s\n", what );
+            failures++;
+        }
+    }
+
+    /* `depth` nested 0x98 loops of `times` around `body` */
+    std::vector<unsigned char> NestedLoops( std::size_t depth, unsigned char times, std::vector<unsigned char> body )
+    {
+        std::vector<unsigned char> channel;
+        for ( std::size_t i = 0; i < depth; i++ )
+            channel.insert( channel.end(), { 0x98, times } );
+        channel.insert( channel.end(), body.begin(), body.end() );
+        channel.insert( channel.end(), depth, 0x99 );
+        channel.push_back( 0x90 );
+        return channel;
+    }
+
+    /* Walks a channel to its end, giving up after `limit` steps so a regression fails instead of hanging */
+    std::size_t Steps( LoopSequencer &sequencer, std::size_t limit )
+    {
+        std::size_t steps = 0;
+        while ( steps < limit and sequencer.Next().has_value() )
+            steps++;
+        return steps;
+    }
+
+    /* Loops nested deeper than maxLoopDepth play once, so ten loops of two only double the rest eight times */
+    void DeepNesting()
+    {
+        const std::vector<unsigned char> bytes = MakeSMD( { NestedLoops( 10, 0x02, { 0x80, 0x01 } ) } );
+        SMD                              smd( std::as_bytes( std::span( bytes ) ) );
+        LoopSequencer                    sequencer = smd.Sequence( 0 );
+
+        std::size_t rests = 0;
+        std::size_t steps = 0;
+        while ( steps++ < 10000 )
+        {
+            auto step = sequencer.Next();
+            if ( not step.has_value() )
+                break;
+            rests += step->instruction.code == 0x80;
+        }
+
+        Check( rests == 256, "ten nested loops of two play the rest 256 times" );
+        Check( sequencer.GetState().tick == 256, "the channel ends after 256 ticks" );
+        Check( sequencer.GetState().finished and not sequencer.Truncated(), "the channel reaches its 0x90" );
+    }
+
+    /* Six loops of 255 around a rest would play for billions of ticks, wrapping the tick counter */
+    void ExpansionLimit( const std::string &path )
+    {
+        const std::vector<unsigned char> bytes = MakeSMD( { NestedLoops( 6, 0xFF, { 0x80, 0x60 } ) } );
+        SMD                              smd( std::as_bytes( std::span( bytes ) ) );
+
+        LoopSequencer sequencer = smd.Sequence( 0 );
+        Steps( sequencer, 2 * LoopSequencer::maxSteps );
+        Check( sequencer.GetState().finished, "the sequencer stops at its limits" );
+        Check( sequencer.Truncated(), "the sequencer reports the truncation" );
+        Check( sequencer.GetState().tick <= LoopSequencer::maxTicks, "the tick stays within maxTicks" );
+
+        /* Zero-length bodies never reach maxTicks, only maxSteps */
+        const std::vector<unsigned char> silent = MakeSMD( { NestedLoops( 6, 0xFF, { 0xE0, 0x40 } ) } );
+        SMD                              quiet( std::as_bytes( std::span( silent ) ) );
+        LoopSequencer                    loops = quiet.Sequence( 0 );
+        Check( Steps( loops, 2 * LoopSequencer::maxSteps ) == LoopSequencer::maxSteps,
+               "zero-length loops stop at maxSteps" );
+        Check( loops.Truncated(), "zero-length loops report the truncation" );
+
+        const Timeline timeline( smd );
+        Check( timeline.Truncated(), "the timeline reports the truncation" );
+
+        Check( smd.ToMIDI( path ) == SMD::Status::ExpansionLimit, "ToMIDI fails at the expansion limit" );
+        Check( not std::filesystem::exists( path ), "ToMIDI writes nothing past the expansion limit" );
+        Check( RenderPreview( smd, path ) == SMD::Status::ExpansionLimit, "the preview fails at the expansion limit" );
+        Check( not std::filesystem::exists( path ), "the preview writes nothing past the expansion limit" );
+    }
+
+    void WithinLimits( const std::string &path )
+    {
+        const std::vector<unsigned char> bytes = MakeSMD( { NestedLoops( 2, 0x03, { 0x80, 0x60 } ) } );
+        SMD                              smd( std::as_bytes( std::span( bytes ) ) );
+
+        LoopSequencer sequencer = smd.Sequence( 0 );
+        Steps( sequencer, 1000 );
+        Check( not sequencer.Truncated(), "a short song is not truncated" );
+        Check( sequencer.GetState().tick == 9 * 0x60, "a short song plays all its loops" );
+        Check( not Timeline( smd ).Truncated(), "the timeline of a short song is not truncated" );
+        Check( smd.ToMIDI( path ) == SMD::Status::Ok, "a short song converts" );
+
+        std::filesystem::remove( path );
+    }
+} // namespace
+
+int main()
+{
+    const std::string path =
+        ( std::filesystem::temp_directory_path() / ( "sequencer_test." + std::to_string( getpid() ) ) ).string();
+
+    DeepNesting();
+    ExpansionLimit( path );
+    WithinLimits( path );
+
+    std::filesystem::remove( path );
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+#include "smd.hpp"
+#include "smd_generator.hpp"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/*
+ * Mutation harness for the unchecked decode path. Every mutant that loads is
+ * decoded twice: by SMD::Decode(), which skips the bounds checks when the
+ * input passed Validate(), and channel by channel through the always checked
+ * SMD::DecodeChannel(). Both have to give the same events. Runs under
+ * -fsanitize=address also catch reads past the buffer that happen to decode
+ * the same.
+ */
+namespace
+{
+    /* Opcodes that carry operands, the ones most likely to run off the end of a channel */
+    constexpr std::array<unsigned char, 8> longOpcodes = { 0x00, 0x80, 0x94, 0x97, 0x9C, 0xC7, 0xD8, 0xE4 };
+
+    bool Same( const EventStream &a, const EventStream &b )
+    {
+        return a.opcode == b.opcode and a.num_parameters == b.num_parameters and a.parameters == b.parameters and
+               a.channel == b.channel and a.tick == b.tick and a.channel_begin == b.channel_begin and
+               a.channel_length == b.channel_length;
+    }
+
+    void DecodeChecked( const SMD &smd, EventStream &events )
+    {
+        events.Clear();
+        for ( std::size_t c = 0; c < smd.Channels().size(); c++ )
+            SMD::DecodeChannel( smd.Channels()[c], c, events );
+    }
+
+    void Mutate( std::mt19937 &random, std::vector<unsigned char> &bytes )
+    {
+        auto roll = [&]( std::size_t n ) { return std::uniform_int_distribution<std::size_t>( 0, n - 1 )( random ); };
+
+        for ( std::size_t n = 1 + roll( 6 ); n > 0; n-- )
+        {
+            std::size_t at = roll( bytes.size() );
+            bytes[at]      = roll( 2 ) == 0 ? longOpcodes[roll( longOpcodes.size() )] : roll( 256 );
+        }
+
+        if ( roll( 4 ) == 0 )
+            bytes.resize( roll( bytes.size() ) );
+    }
+
+    void Usage( const char *program )
+    {
+        std::fprintf( stderr, "Usage: %s [--seed N] [--channels N] [--size BYTES_PER_CHANNEL] [--iterations N]\n",
+                      program );
+    }
+} // namespace
+
+int main( int argc, char **argv )
+{
+    GeneratorOptions options;
+    unsigned int     iterations = 20000;
+
+    options.channels          = 4;
+    options.bytes_per_channel = 256;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( i + 1 >= argc )
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+
+        if ( std::strcmp( argv[i], "--seed" ) == 0 )
+            options.seed = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--channels" ) == 0 )
+            options.channels = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--size" ) == 0 )
+            options.bytes_per_channel = std::strtoul( argv[++i], nullptr, 10 );
+        else if ( std::strcmp( argv[i], "--iterations" ) == 0 )
+            iterations = std::strtoul( argv[++i], nullptr, 10 );
+        else
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::vector<unsigned char> original = GenerateSMD( options );
+    std::mt19937                     random( options.seed );
+
+    SMD                        smd;
+    EventStream                fast, checked;
+    std::vector<unsigned char> mutant;
+    std::size_t                loaded = 0, validated = 0, mismatches = 0;
+
+    for ( unsigned int i = 0; i < iterations; i++ )
+    {
+        mutant = original;
+        Mutate( random, mutant );
+
+        if ( smd.Load( std::as_bytes( std::span( mutant ) ) ) != SMD::Status::Ok )
+            continue;
+
+        loaded++;
+        validated += smd.Validated();
+
+        smd.Decode( fast, 1 );
+        DecodeChecked( smd, checked );
+
+        if ( not Same( fast, checked ) )
+        {
+            if ( mismatches == 0 )
+                std::fprintf( stderr, "Mismatch at iteration %u (seed %u, validated %d)\n", i, options.seed,
+                              smd.Validated() );
+            mismatches++;
+        }
+    }
+
+    std::printf( "%u mutants, %zu loaded, %zu validated, %zu mismatches\n", iterations, loaded, validated,
+                 mismatches );
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}